@@ -0,0 +1,97 @@
+// C ABI over Corpus (see bible.h)
+
+#include "bible.h"
+#include "corpus.h"
+
+struct bible {
+    Corpus corpus;
+};
+
+bible* bible_open(const char* dir) {
+    bible* b = new bible;
+    if (!b->corpus.open(dir)) {
+        delete b;
+        return NULL;
+    }
+    return b;
+}
+
+void bible_close(bible* b) { delete b; }
+
+uint32_t bible_size(bible* b) { return b->corpus.size(); }
+
+int bible_book_count(bible* b) { return b->corpus.book_count(); }
+
+const char* bible_book_name(bible* b, int book) { return b->corpus.book_name(book); }
+
+int bible_find_book(bible* b, const char* name) { return b->corpus.find_book(name); }
+
+int bible_chapter_count(bible* b, int book) { return b->corpus.chapter_count(book); }
+
+int bible_lookup(bible* b, int book, int chapter, int verse, uint32_t* first, uint32_t* count) {
+    return b->corpus.lookup(book, chapter, verse, first, count);
+}
+
+int bible_verse_at(bible* b, uint32_t index, bible_verse* out) {
+    const Verse* v = b->corpus.verse(index);
+    if (!v) return 0;
+    out->ref = v->ref.packed;
+    out->title = v->title;
+    out->text = v->text;
+    out->refs = v->refs;
+    return 1;
+}
+
+static int search_flags(int flags) {
+    return ((flags & BIBLE_SEARCH_WORD) ? SEARCH_WORD : 0) | ((flags & BIBLE_SEARCH_REGEX) ? SEARCH_REGEX : 0) |
+           ((flags & BIBLE_SEARCH_QUERY) ? SEARCH_QUERY : 0) | ((flags & BIBLE_SEARCH_STEM) ? SEARCH_STEM : 0);
+}
+
+size_t bible_search(bible* b, const char* query, int flags, uint32_t from, uint32_t* ids, size_t cap) {
+    return b->corpus.search(query, search_flags(flags), from, ids, cap);
+}
+
+uint32_t bible_count(bible* b, const char* query, int flags, uint32_t from) {
+    return b->corpus.count(query, search_flags(flags), from);
+}
+
+int bible_set_cache(bible* b, const char* dir, size_t max_bytes) { return b->corpus.set_cache(dir, max_bytes); }
+
+// bible_word_freq / bible_word_hit have the layout of WordFreq / WordHit
+size_t bible_freq(bible* b, int by, size_t top, bible_word_freq* out, size_t cap) {
+    return b->corpus.freq(by, top, (WordFreq*)out, cap);
+}
+
+size_t bible_concordance(bible* b, const char* word, uint32_t from, bible_word_hit* out, size_t cap) {
+    return b->corpus.concordance(word, from, (WordHit*)out, cap);
+}
+
+// bible_hit_count has the layout of HitCount
+size_t bible_histogram(bible* b, const char* query, int flags, int by, bible_hit_count* out, size_t cap) {
+    return b->corpus.histogram(query, search_flags(flags), by, (HitCount*)out, cap);
+}
+
+const char* bible_error(bible* b) { return b->corpus.error(); }
+
+void bible_search_stats(bible* b, bible_stats* out) {
+    const SearchStats* s = b->corpus.stats();
+    out->chapters = s->chapters;
+    out->skipped = s->skipped;
+}
+
+const char* bible_folded(bible* b, uint32_t index) { return b->corpus.folded(index); }
+
+size_t bible_original_offset(bible* b, uint32_t index, size_t off) { return b->corpus.original_offset(index, off); }
+
+size_t bible_matches(bible* b, uint32_t index, const char* query, int flags, bible_match* out, size_t cap) {
+    return b->corpus.matches(index, query, search_flags(flags), (MatchSpan*)out, cap);
+}
+
+// bible_section has the layout of SectionTitle
+size_t bible_titles(bible* b, int book, int chapter, bible_section* out, size_t cap) {
+    return b->corpus.titles(book, chapter, (SectionTitle*)out, cap);
+}
+
+size_t bible_find_titles(bible* b, const char* query, int flags, bible_section* out, size_t cap) {
+    return b->corpus.find_titles(query, search_flags(flags), (SectionTitle*)out, cap);
+}
@@ -0,0 +1,114 @@
+#ifndef BIBLE_H
+#define BIBLE_H
+
+/* C interface to the corpus library (corpus.h), for callers that are not
+ * C++. Same rules: strings point into the library and stay valid until
+ * bible_close(), nothing needs freeing. */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct bible bible;
+
+/* Packed verse reference: book in the top 8 bits, chapter and verse 12 each */
+#define BIBLE_REF_BOOK(r) ((int)((r) >> 24))
+#define BIBLE_REF_CHAPTER(r) ((int)(((r) >> 12) & 0xFFF))
+#define BIBLE_REF_VERSE(r) ((int)((r) & 0xFFF))
+
+#define BIBLE_SEARCH_WORD 1
+#define BIBLE_SEARCH_REGEX 2
+#define BIBLE_SEARCH_QUERY 4
+#define BIBLE_SEARCH_STEM 8
+
+typedef struct {
+    uint32_t ref;
+    const char* title;
+    const char* text;
+    const char* refs;
+} bible_verse;
+
+#define BIBLE_FREQ_ALL 0
+#define BIBLE_FREQ_BOOK 1
+#define BIBLE_FREQ_TESTAMENT 2
+
+typedef struct {
+    int group;  /* 0, book 1-66, or testament 1 (old) / 2 (new) */
+    const char* word;  /* folded, len bytes, not NUL terminated */
+    uint32_t len;
+    uint32_t count;
+} bible_word_freq;
+
+typedef struct {
+    uint32_t index;
+    uint32_t offset;  /* in bible_folded(index) */
+} bible_word_hit;
+
+typedef struct {
+    uint32_t start, end;  /* [start, end) bytes of the verse text */
+} bible_match;
+
+typedef struct {
+    uint32_t index;  /* verse the section starts at */
+    uint32_t ref;
+    const char* title;
+} bible_section;
+
+#define BIBLE_HIST_BOOK 0
+#define BIBLE_HIST_CHAPTER 1
+
+typedef struct {
+    uint32_t ref;     /* book and chapter (0 per book), verse 0 */
+    uint32_t verses;  /* matching verses */
+    uint32_t hits;    /* matches in them */
+} bible_hit_count;
+
+typedef struct {
+    uint32_t chapters;  /* checked against the bible_data.blm filters */
+    uint32_t skipped;   /* of them, ruled out without decoding */
+} bible_stats;
+
+bible* bible_open(const char* dir);  /* NULL if no data found */
+void bible_close(bible* b);
+
+uint32_t bible_size(bible* b);
+int bible_book_count(bible* b);
+const char* bible_book_name(bible* b, int book);  /* 1-based */
+int bible_find_book(bible* b, const char* name);  /* 0 if unknown */
+int bible_chapter_count(bible* b, int book);
+int bible_lookup(bible* b, int book, int chapter, int verse, uint32_t* first, uint32_t* count);
+int bible_verse_at(bible* b, uint32_t index, bible_verse* out);  /* 0 past the end */
+
+/* Matching verse indexes >= from, in corpus order */
+size_t bible_search(bible* b, const char* query, int flags, uint32_t from, uint32_t* ids, size_t cap);
+uint32_t bible_count(bible* b, const char* query, int flags, uint32_t from);
+const char* bible_error(bible* b);  /* bad query of the last search, or NULL */
+void bible_search_stats(bible* b, bible_stats* out);  /* what the last search scanned */
+/* On-disk result cache shared between processes; dir NULL turns it off */
+int bible_set_cache(bible* b, const char* dir, size_t max_bytes);
+
+/* Top words overall / per book / per testament, and every hit of one word */
+size_t bible_freq(bible* b, int by, size_t top, bible_word_freq* out, size_t cap);
+size_t bible_concordance(bible* b, const char* word, uint32_t from, bible_word_hit* out, size_t cap);
+/* Every match of a query (bible_search flags) counted per book / chapter */
+size_t bible_histogram(bible* b, const char* query, int flags, int by, bible_hit_count* out, size_t cap);
+
+/* Folded text of a verse and the mapping of folded offsets back to text */
+const char* bible_folded(bible* b, uint32_t index);
+size_t bible_original_offset(bible* b, uint32_t index, size_t off);
+/* Where a query (bible_search flags) matches verse index, for highlighting */
+size_t bible_matches(bible* b, uint32_t index, const char* query, int flags, bible_match* out, size_t cap);
+
+/* Section titles of a book (0: all) / chapter (0: all), or those a query
+ * matches; from bible_data.toc without decoding verses when present */
+size_t bible_titles(bible* b, int book, int chapter, bible_section* out, size_t cap);
+size_t bible_find_titles(bible* b, const char* query, int flags, bible_section* out, size_t cap);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,133 @@
+// Chapter filters written by `extractor -blooms` (see cmd/extractor/bloom.go):
+// a Bloom filter per chapter over the trigrams of its folded verses. A scan
+// for a literal checks the literal's trigrams first and skips every chapter
+// missing one, so those verses are never decoded, folded or matched.
+
+#include <cstring>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "corpus_impl.h"
+
+struct BloomIndex {
+    const unsigned char* map;
+    size_t map_len;
+    int hashes;
+    uint32_t nverses, nblocks;
+    const unsigned char* first;   // u32 per block, +1
+    const unsigned char* words;   // u32 per block, +1
+    const unsigned char* bits;    // u64 words
+};
+
+// Same as trigramHash in cmd/extractor/bloom.go
+static uint32_t trigram_hash(const unsigned char* t) {
+    uint32_t x = ((uint32_t)t[0] << 16 | (uint32_t)t[1] << 8 | t[2]) * 0x9E3779B1u;
+    x ^= x >> 15;
+    x *= 0x85EBCA6Bu;
+    x ^= x >> 13;
+    return x;
+}
+
+BloomIndex* blm_open(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < 16) { close(fd); return NULL; }
+    void* m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED) return NULL;
+    BloomIndex* bi = new BloomIndex();
+    bi->map = (const unsigned char*)m;
+    bi->map_len = st.st_size;
+    bi->hashes = bi->map[5];
+    bi->nverses = rd32(bi->map + 8);
+    bi->nblocks = rd32(bi->map + 12);
+    bi->first = bi->map + 16;
+    bi->words = bi->first + 4 * ((size_t)bi->nblocks + 1);
+    bi->bits = bi->words + 4 * ((size_t)bi->nblocks + 1);
+    // Both tables, then as many filter words as the last offset says
+    if (memcmp(bi->map, "BBLM", 4) != 0 || bi->map[4] != 1 || !bi->hashes ||
+        (bi->map_len - 16) / 8 < (size_t)bi->nblocks + 1 ||
+        (bi->map_len - (bi->bits - bi->map)) / 8 < rd32(bi->words + 4 * (size_t)bi->nblocks)) {
+        blm_close(bi);
+        return NULL;
+    }
+    for (uint32_t b = 0; b < bi->nblocks; b++) {
+        if (rd32(bi->first + 4 * b) > rd32(bi->first + 4 * (b + 1)) || rd32(bi->words + 4 * b) >= rd32(bi->words + 4 * (b + 1))) {
+            blm_close(bi);
+            return NULL;
+        }
+    }
+    return bi;
+}
+
+void blm_close(BloomIndex* bi) {
+    if (!bi) return;
+    munmap((void*)bi->map, bi->map_len);
+    delete bi;
+}
+
+uint32_t blm_verses(BloomIndex* bi) { return bi->nverses; }
+
+size_t blm_trigrams(const char* literal, std::vector<uint32_t>* out) {
+    const unsigned char* t = (const unsigned char*)literal;
+    out->clear();
+    for (size_t i = 0; t[i] && t[i + 1] && t[i + 2]; i++)
+        if (is_word_byte(t[i]) && is_word_byte(t[i + 1]) && is_word_byte(t[i + 2])) out->push_back(trigram_hash(t + i));
+    std::sort(out->begin(), out->end());
+    out->erase(std::unique(out->begin(), out->end()), out->end());
+    return out->size();
+}
+
+static bool may_hold(const BloomIndex* bi, uint32_t b, const std::vector<uint32_t>& trigrams) {
+    uint32_t lo = rd32(bi->words + 4 * b), m = 64 * (rd32(bi->words + 4 * (b + 1)) - lo);
+    const unsigned char* bits = bi->bits + 8 * (size_t)lo;
+    for (size_t k = 0; k < trigrams.size(); k++) {
+        uint32_t h = trigrams[k];
+        for (int i = 0; i < bi->hashes; i++) {
+            uint32_t bit = (h + i * (h >> 17 | 1)) % m;
+            if (!(bits[bit / 8] >> (bit % 8) & 1)) return false;
+        }
+    }
+    return true;
+}
+
+size_t bloom_scan(Corpus::Impl* c, BloomIndex* bi, const std::vector<uint32_t>& trigrams,
+                  bool (*match)(const char* folded, void* arg), void* arg, const char* must,
+                  uint32_t after, uint32_t* ids, size_t cap) {
+    char buf[MAX_LINE * 2 + 8], norm[MAX_LINE * 2];
+    size_t n = 0;
+    uint32_t b = 0, skipped = 0, seen = 0;
+    while (b < bi->nblocks && rd32(bi->first + 4 * (b + 1)) <= after) b++;
+    // Verses past the last block (a text grown since) are scanned unfiltered
+    for (uint32_t i = after; n < cap || !ids; i++) {
+        while (b < bi->nblocks && i >= rd32(bi->first + 4 * (b + 1))) b++;
+        if (b < bi->nblocks && i == std::max(after, rd32(bi->first + 4 * b))) {
+            seen++;
+            if (!may_hold(bi, b, trigrams)) {
+                skipped++;
+                i = rd32(bi->first + 4 * (b + 1)) - 1;
+                continue;
+            }
+        }
+        // Folded by the shadow already, or decoded and folded here just once
+        const char* folded;
+        if (i < c->shadow.text.size()) {
+            folded = c->shadow.text[i];
+        } else {
+            ensure_verse(c, i);
+            if (i >= c->nverses) break;
+            normalize_into(scan_text(c, i, buf), norm);
+            folded = norm;
+        }
+        if (strstr(folded, must) && (!match || match(folded, arg))) {
+            if (ids) ids[n] = i;
+            n++;
+        }
+    }
+    c->stats.chapters += seen;
+    c->stats.skipped += skipped;
+    return n;
+}
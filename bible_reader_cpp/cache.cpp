@@ -0,0 +1,200 @@
+// On-disk cache of search results. One file per query holds every matching
+// verse index as delta varints, keyed by the normalized query, the search
+// flags and a hash of the data files a search reads, so a popular search is
+// answered from a few hundred bytes instead of a decode and scan.
+//
+// Files are written to a temporary name and renamed into place, so other
+// processes see a whole entry or none. The mtime of an entry is its last
+// use; when the directory grows past its bound the oldest entries go.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "corpus_impl.h"
+
+#define CACHE_MAGIC "BHIT"
+#define CACHE_VERSION 1
+
+struct ResultCache {
+    char dir[MAX_LINE];
+    size_t max_bytes;
+    uint64_t corpus;           // hash of the data files in use
+};
+
+static uint64_t fnv64(const void* data, size_t n, uint64_t h = 14695981039346656037ull) {
+    const unsigned char* p = (const unsigned char*)data;
+    for (size_t i = 0; i < n; i++) h = (h ^ p[i]) * 1099511628211ull;
+    return h;
+}
+
+static bool read_file(const char* path, std::string* out) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return false;
+    char buf[65536];
+    out->clear();
+    for (size_t n; (n = fread(buf, 1, sizeof(buf), f)) > 0;) out->append(buf, n);
+    fclose(f);
+    return true;
+}
+
+// Temp file + rename: readers never see half an entry
+static bool write_atomic(const ResultCache* rc, const char* name, const std::string& data) {
+    char tmp[MAX_LINE * 2], path[MAX_LINE * 2];
+    snprintf(tmp, sizeof(tmp), "%s/.%s.%d", rc->dir, name, (int)getpid());
+    snprintf(path, sizeof(path), "%s/%s", rc->dir, name);
+    FILE* f = fopen(tmp, "wb");
+    if (!f) return false;
+    bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+    ok = fclose(f) == 0 && ok;
+    if (!ok || rename(tmp, path) != 0) {
+        unlink(tmp);
+        return false;
+    }
+    return true;
+}
+
+// Hashing the whole file on every start would cost more than most searches,
+// so the hash is kept per file identity (device, inode) with size and mtime
+static uint64_t corpus_hash(const ResultCache* rc, const char* file) {
+    struct stat st;
+    if (stat(file, &st) != 0) return 0;
+    char name[128], line[128];
+    snprintf(name, sizeof(name), "corpus-%llx-%llx.id", (unsigned long long)st.st_dev, (unsigned long long)st.st_ino);
+    snprintf(line, sizeof(line), "%lld %lld.%09ld ", (long long)st.st_size, (long long)st.st_mtim.tv_sec, (long)st.st_mtim.tv_nsec);
+
+    char path[MAX_LINE * 2];
+    snprintf(path, sizeof(path), "%s/%s", rc->dir, name);
+    std::string known;
+    if (read_file(path, &known) && known.compare(0, strlen(line), line) == 0)
+        return strtoull(known.c_str() + strlen(line), NULL, 16);
+
+    std::string data;
+    if (!read_file(file, &data)) return 0;
+    uint64_t h = fnv64(data.data(), data.size());
+    char entry[160];
+    snprintf(entry, sizeof(entry), "%s%016llx\n", line, (unsigned long long)h);
+    write_atomic(rc, name, entry);
+    return h;
+}
+
+// files[0] must exist; the others count as 0 when missing, so adding or
+// removing one changes the hash too
+ResultCache* cache_open(const char* dir, size_t max_bytes, const char* const* files, int nfiles) {
+    mkdir(dir, 0755);
+    ResultCache* rc = new ResultCache();
+    snprintf(rc->dir, sizeof(rc->dir), "%s", dir);
+    rc->max_bytes = max_bytes;
+    uint64_t h = corpus_hash(rc, files[0]);
+    if (!h) {
+        delete rc;
+        return NULL;
+    }
+    for (int i = 1; i < nfiles; i++) {
+        uint64_t f = corpus_hash(rc, files[i]);
+        h = fnv64(&f, sizeof(f), h);
+    }
+    rc->corpus = h;
+    return rc;
+}
+
+void cache_close(ResultCache* rc) { delete rc; }
+
+static void entry_name(const ResultCache* rc, const std::string& key, char* name, size_t n) {
+    snprintf(name, n, "%016llx.hit", (unsigned long long)fnv64(key.data(), key.size(), rc->corpus));
+}
+
+// Entry: "BHIT" u32 version, u64 corpus hash, u32 key length, key,
+// u32 count, varint deltas of the verse indexes
+static void put32(std::string* s, uint32_t v) { s->append((const char*)&v, 4); }
+
+bool cache_get(ResultCache* rc, const std::string& key, std::vector<uint32_t>* ids) {
+    char name[64], path[MAX_LINE * 2];
+    entry_name(rc, key, name, sizeof(name));
+    snprintf(path, sizeof(path), "%s/%s", rc->dir, name);
+    std::string d;
+    if (!read_file(path, &d) || d.size() < 24 || memcmp(d.data(), CACHE_MAGIC, 4) != 0) return false;
+    const unsigned char* p = (const unsigned char*)d.data();
+    const unsigned char* end = p + d.size();
+    uint64_t corpus;
+    memcpy(&corpus, p + 8, 8);
+    uint32_t klen = rd32(p + 16);
+    if (rd32(p + 4) != CACHE_VERSION || corpus != rc->corpus || 24 + (size_t)klen > d.size() ||
+        key.compare(0, std::string::npos, (const char*)p + 20, klen) != 0)
+        return false;
+    p += 20 + klen;
+    uint32_t n = rd32(p), last = 0;
+    p += 4;
+    ids->clear();
+    ids->reserve(n);
+    while (ids->size() < n && p < end) {
+        uint32_t v = 0;
+        for (int shift = 0; p < end; shift += 7) {
+            v |= (uint32_t)(*p & 0x7F) << shift;
+            if (!(*p++ & 0x80)) break;
+        }
+        last += v;
+        ids->push_back(last);
+    }
+    if (ids->size() != n) return false;
+    utimensat(AT_FDCWD, path, NULL, 0); // last use, for the LRU
+    return true;
+}
+
+struct CacheEntry {
+    long long used;            // mtime in ns
+    off_t size;
+    std::string name;
+};
+
+static bool by_use(const CacheEntry& a, const CacheEntry& b) { return a.used < b.used; }
+
+// Drops least recently used entries until the directory fits its bound
+static void cache_evict(ResultCache* rc) {
+    DIR* d = opendir(rc->dir);
+    if (!d) return;
+    std::vector<CacheEntry> entries;
+    size_t total = 0;
+    char path[MAX_LINE * 2];
+    for (struct dirent* e; (e = readdir(d));) {
+        size_t len = strlen(e->d_name);
+        if (len < 4 || e->d_name[0] == '.' || strcmp(e->d_name + len - 4, ".hit") != 0) continue;
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%s", rc->dir, e->d_name);
+        if (stat(path, &st) != 0) continue;
+        CacheEntry ce = { (long long)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec, st.st_size, e->d_name };
+        entries.push_back(ce);
+        total += st.st_size;
+    }
+    closedir(d);
+    if (total <= rc->max_bytes) return;
+    std::sort(entries.begin(), entries.end(), by_use);
+    for (size_t i = 0; i < entries.size() && total > rc->max_bytes; i++) {
+        snprintf(path, sizeof(path), "%s/%s", rc->dir, entries[i].name.c_str());
+        // Another process may have evicted it already
+        if (unlink(path) == 0) total -= entries[i].size;
+    }
+}
+
+void cache_put(ResultCache* rc, const std::string& key, const std::vector<uint32_t>& ids) {
+    std::string d(CACHE_MAGIC, 4);
+    put32(&d, CACHE_VERSION);
+    d.append((const char*)&rc->corpus, 8);
+    put32(&d, key.size());
+    d += key;
+    put32(&d, ids.size());
+    uint32_t last = 0;
+    for (size_t i = 0; i < ids.size(); i++) {
+        uint32_t v = ids[i] - last;
+        last = ids[i];
+        for (; v >= 0x80; v >>= 7) d += (char)(v | 0x80);
+        d += (char)v;
+    }
+    char name[64];
+    entry_name(rc, key, name, sizeof(name));
+    if (write_atomic(rc, name, d)) cache_evict(rc);
+}
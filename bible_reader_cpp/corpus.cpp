@@ -0,0 +1,715 @@
+// Corpus: one verse table filled from whichever source is available.
+//
+// bible_data.vrs gives the whole structure from its header and decodes verses
+// on first use, bible_data.tok needs one walk over the token IDs, and the
+// plain xz stream is parsed only as far as a call needs it, so a read of
+// Geneza 1 still stops after the first chapter. bible_data.toc, when there,
+// answers the structure and the section titles so that list / toc never
+// start the decoder.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <algorithm>
+#include <unistd.h>
+#include "corpus_impl.h"
+
+#define ARENA_BLOCK (64 * 1024)
+
+// A folded letter shrinks from 2 bytes to 1; its position goes into folds
+#define FOLD(ch) { if (folds) folds->push_back((uint16_t)(out - buf)); *out++ = ch; str += 2; continue; }
+
+size_t normalize_into(const char* str, char* buf, std::vector<uint16_t>* folds) {
+    char* out = buf;
+    while (*str) {
+        unsigned char c1 = (unsigned char)str[0];
+        if (c1 > 127 && str[1]) {
+            unsigned char c2 = (unsigned char)str[1];
+            // Romanian Diacritics
+            if (c1 == 0xC4 && c2 == 0x83) FOLD('a') // ă
+            if (c1 == 0xC3 && c2 == 0xA2) FOLD('a') // â
+            if (c1 == 0xC3 && c2 == 0xAE) FOLD('i') // î
+            if (c1 == 0xC8 && c2 == 0x99) FOLD('s') // ș
+            if (c1 == 0xC5 && c2 == 0x9F) FOLD('s') // ş
+            if (c1 == 0xC8 && c2 == 0x9B) FOLD('t') // ț
+            if (c1 == 0xC5 && c2 == 0xA3) FOLD('t') // ţ
+            if (c1 == 0xC4 && c2 == 0x82) FOLD('a') // Ă
+        }
+        *out++ = tolower((unsigned char)*str++);
+    }
+    *out = 0;
+    return out - buf;
+}
+
+uint32_t rd32(const unsigned char* p) { uint32_t v; memcpy(&v, p, 4); return v; }
+
+bool is_word_byte(unsigned char c) { return isalnum(c) || c >= 0x80; }
+
+// Whole word check for the text scans, matching the tokenizer in
+// cmd/extractor: letters/digits (multibyte letters too), but „ ” – … (E2 xx xx)
+// and the <span> markup are separators.
+// m (qlen bytes) starts and ends on word boundaries and is not inside a tag
+static bool word_at(const char* text, const char* m, size_t qlen, bool whole_word) {
+    if (whole_word && m > text) {
+        const char* lead = m - 1;
+        while (lead > text && ((unsigned char)*lead & 0xC0) == 0x80) lead--;
+        if (is_word_byte((unsigned char)*lead) && (unsigned char)*lead != 0xE2) return false;
+    }
+    unsigned char a = (unsigned char)m[qlen];
+    if (whole_word && a && is_word_byte(a) && a != 0xE2) return false;
+    const char* lt = m;
+    while (lt > text && *lt != '<' && *lt != '>') lt--;
+    return *lt != '<';
+}
+
+bool word_match(const char* text, const char* q) {
+    size_t qlen = strlen(q);
+    for (const char* m = strstr(text, q); m; m = strstr(m + 1, q))
+        if (word_at(text, m, qlen, true)) return true;
+    return false;
+}
+
+void term_spans(const char* text, const char* q, bool whole_word, std::vector<uint32_t>* spans) {
+    size_t qlen = strlen(q);
+    if (!qlen) return;
+    for (const char* m = strstr(text, q); m; m = strstr(m + 1, q)) {
+        if (!word_at(text, m, qlen, whole_word)) continue;
+        spans->push_back(m - text);
+        spans->push_back(m - text + qlen);
+        m += qlen - 1;
+    }
+}
+
+char* arena_dup(Arena* a, const char* s, size_t n) {
+    if (n + 1 > a->left) {
+        size_t size = n + 1 > ARENA_BLOCK ? n + 1 : ARENA_BLOCK;
+        a->p = (char*)malloc(size);
+        a->left = size;
+        a->blocks.push_back(a->p);
+    }
+    char* r = a->p;
+    memcpy(r, s, n);
+    r[n] = 0;
+    a->p += n + 1;
+    a->left -= n + 1;
+    return r;
+}
+
+void arena_free(Arena* a) {
+    for (size_t i = 0; i < a->blocks.size(); i++) free(a->blocks[i]);
+    a->blocks.clear();
+    a->p = NULL;
+    a->left = 0;
+}
+
+static Verse* verse_slot(Corpus::Impl* c, uint32_t i) { return &c->pages[i / VERSE_PAGE][i % VERSE_PAGE]; }
+
+// Text fields stay NULL until the verse is materialized
+Verse* add_verse(Corpus::Impl* c, VerseRef ref) {
+    if (c->nverses % VERSE_PAGE == 0) c->pages.push_back((Verse*)calloc(VERSE_PAGE, sizeof(Verse)));
+    Verse* v = verse_slot(c, c->nverses++);
+    v->ref = ref;
+    return v;
+}
+
+void add_book(Corpus::Impl* c, const char* name, size_t len) {
+    BookInfo b = { arena_dup(&c->arena, name, len), (uint32_t)c->chapter_first.size(), 0 };
+    c->books.push_back(b);
+}
+
+void add_chapter(Corpus::Impl* c) {
+    c->chapter_first.push_back(c->nverses);
+    if (!c->books.empty()) c->books.back().nchapters++;
+}
+
+// Parses one more line of the xz stream; false once the stream is done
+static bool xz_step(Corpus::Impl* c) {
+    if (c->complete) return false;
+    char* line = xz_line(c->xz);
+    if (!line) {
+        xz_close(c->xz);
+        c->xz = NULL;
+        c->complete = true;
+        return false;
+    }
+    bool verse = false;
+    if (line[0] == '#') {
+        add_book(c, line[1] ? line + 2 : "", line[1] ? strlen(line + 2) : 0);
+        c->chapter = 0;
+        c->pending_title = NULL;
+    } else if (line[0] == '=') {
+        add_chapter(c);
+        c->chapter = atoi(line + 1);
+        c->pending_title = NULL;
+    } else if (line[0] == 'T') {
+        c->pending_title = line[1] ? arena_dup(&c->arena, line + 2, strlen(line + 2)) : "";
+    } else if (line[0] == 'R') {
+        // Only the line right after a verse holds its refs
+        if (c->last_was_verse && line[1]) verse_slot(c, c->nverses - 1)->refs = arena_dup(&c->arena, line + 2, strlen(line + 2));
+    } else if (isdigit((unsigned char)line[0])) {
+        char* sp = strchr(line, ' ');
+        if (sp) {
+            Verse* v = add_verse(c, VerseRef::make((int)c->books.size(), c->chapter, atoi(line)));
+            v->title = c->pending_title ? c->pending_title : "";
+            v->text = arena_dup(&c->arena, sp + 1, strlen(sp + 1));
+            v->refs = "";
+            c->pending_title = NULL;
+            verse = true;
+        }
+    }
+    c->last_was_verse = verse;
+    return true;
+}
+
+// Verse i is final once a line after it was parsed (its refs are known)
+void ensure_verse(Corpus::Impl* c, uint32_t i) {
+    while (!c->complete && !(i + 1 < c->nverses || (i < c->nverses && !c->last_was_verse))) xz_step(c);
+}
+
+void ensure_books(Corpus::Impl* c, size_t n) {
+    while (!c->complete && c->books.size() < n) xz_step(c);
+}
+
+// Chapter g (global index) is final once the next one started
+void ensure_chapter(Corpus::Impl* c, size_t g) {
+    while (!c->complete && g + 1 >= c->chapter_first.size()) xz_step(c);
+}
+
+static TokCorpus* word_index(Corpus::Impl* c) {
+    if (!c->tok_tried) {
+        c->tok_tried = true;
+        if (!c->tok) {
+            char path[MAX_LINE * 2];
+            snprintf(path, sizeof(path), "%s/%s", c->dir, TOK_FILE);
+            c->tok = tok_open(path);
+        }
+    }
+    return c->tok;
+}
+
+// The token stream only knows words and the single spaces implied between
+// them. A folded query with anything else (punctuation, „ ”, leading or
+// doubled spaces) is matched on the text, where its separators still are.
+static bool words_only(const char* q) {
+    const unsigned char* p = (const unsigned char*)q;
+    if (!*p || *p == ' ') return false;
+    for (; *p; p++) {
+        if (*p == ' ' ? p[1] == ' ' || !p[1] : !is_word_byte(*p) || *p == 0xE2) return false;
+    }
+    return true;
+}
+
+// bible_data.stm, unless it was built from a different text
+static StemIndex* stem_index(Corpus::Impl* c) {
+    if (!c->stm_tried) {
+        c->stm_tried = true;
+        char path[MAX_LINE * 2];
+        snprintf(path, sizeof(path), "%s/%s", c->dir, STM_FILE);
+        c->stm = stm_open(path);
+        if (c->stm && c->complete && stm_verses(c->stm) != c->nverses) {
+            stm_close(c->stm);
+            c->stm = NULL;
+        }
+    }
+    return c->stm;
+}
+
+// bible_data.blm, unless it was built from a different text
+BloomIndex* bloom_index(Corpus::Impl* c) {
+    if (!c->blm_tried) {
+        c->blm_tried = true;
+        char path[MAX_LINE * 2];
+        snprintf(path, sizeof(path), "%s/%s", c->dir, BLM_FILE);
+        c->blm = blm_open(path);
+    }
+    if (c->blm && c->complete && blm_verses(c->blm) != c->nverses) {
+        blm_close(c->blm);
+        c->blm = NULL;
+    }
+    return c->blm;
+}
+
+// Verse text for a scan: streamed verses are kept anyway, the side files
+// decode into buf without materializing anything
+const char* scan_text(Corpus::Impl* c, uint32_t i, char* buf) {
+    switch (c->kind) {
+    case SRC_VRS: return vs_text(c->vrs, i, buf);
+    case SRC_TOK: return tok_text(c->tok, &c->tok_verses[i], buf);
+    default: return verse_slot(c, i)->text;
+    }
+}
+
+Corpus::Corpus() : impl(NULL) {}
+
+Corpus::~Corpus() { close(); }
+
+bool Corpus::open(const char* dir) {
+    close();
+    impl = new Impl();
+    Impl* c = impl;
+    snprintf(c->dir, sizeof(c->dir), "%s", dir);
+    char path[MAX_LINE * 2];
+
+    snprintf(path, sizeof(path), "%s/%s", dir, TOC_FILE);
+    c->toc = toc_open(path);
+    snprintf(path, sizeof(path), "%s/%s", dir, VRS_FILE);
+    if ((c->vrs = vs_open(path))) {
+        c->kind = SRC_VRS;
+        vs_index(c->vrs, c);
+        c->canon = vs_canon(c->vrs);
+        c->complete = true;
+        return true;
+    }
+    snprintf(path, sizeof(path), "%s/%s", dir, TOK_FILE);
+    if ((c->tok = tok_open(path))) {
+        c->kind = SRC_TOK;
+        c->tok_tried = true;
+        tok_index(c->tok, c, &c->tok_verses);
+        c->complete = true;
+        return true;
+    }
+    snprintf(path, sizeof(path), "%s/%s", dir, DATA_FILE);
+    if (access(path, R_OK) != 0 || !(c->xz = xz_open(path))) {
+        close();
+        return false;
+    }
+    c->kind = SRC_XZ;
+    return true;
+}
+
+void Corpus::close() {
+    if (!impl) return;
+    if (impl->xz) xz_close(impl->xz);
+    tok_close(impl->tok);
+    vs_close(impl->vrs);
+    stm_close(impl->stm);
+    blm_close(impl->blm);
+    toc_close(impl->toc);
+    for (size_t i = 0; i < impl->pages.size(); i++) free(impl->pages[i]);
+    arena_free(&impl->arena);
+    shadow_free(&impl->shadow);
+    re_free(impl->re);
+    cache_close(impl->cache);
+    delete impl;
+    impl = NULL;
+}
+
+void Corpus::load() {
+    while (xz_step(impl)) {}
+    for (uint32_t i = 0; i < impl->nverses; i++) verse(i);
+    shadow_extend(impl, impl->nverses);
+}
+
+uint32_t Corpus::size() {
+    while (xz_step(impl)) {}
+    return impl->nverses;
+}
+
+const Verse* Corpus::verse(uint32_t index) {
+    Impl* c = impl;
+    ensure_verse(c, index);
+    if (index >= c->nverses) return NULL;
+    Verse* v = verse_slot(c, index);
+    if (!v->text) {
+        if (c->kind == SRC_VRS) vs_materialize(c->vrs, index, v, &c->arena);
+        else tok_materialize(c->tok, &c->tok_verses[index], v, &c->arena);
+    }
+    return v;
+}
+
+// The TOC stands in for the stream until the stream was parsed to the end
+static Toc* toc_for_structure(Corpus::Impl* c) { return c->complete ? NULL : c->toc; }
+
+int Corpus::book_count() {
+    if (Toc* t = toc_for_structure(impl)) return toc_books(t);
+    while (xz_step(impl)) {}
+    return (int)impl->books.size();
+}
+
+const char* Corpus::book_name(int book) {
+    if (book < 1) return NULL;
+    if (Toc* t = toc_for_structure(impl)) return toc_book_name(t, book);
+    ensure_books(impl, book);
+    return book <= (int)impl->books.size() ? impl->books[book - 1].name : NULL;
+}
+
+int Corpus::find_book(const char* name) {
+    if (Toc* t = toc_for_structure(impl)) {
+        for (int b = 1; b <= toc_books(t); b++)
+            if (strcasecmp(toc_book_name(t, b), name) == 0) return b;
+        return 0;
+    }
+    for (size_t b = 0;; b++) {
+        ensure_books(impl, b + 1);
+        if (b >= impl->books.size()) return 0;
+        if (strcasecmp(impl->books[b].name, name) == 0) return (int)b + 1;
+    }
+}
+
+bool Corpus::lookup(int book, int chapter, int verse, uint32_t* first, uint32_t* count) {
+    Impl* c = impl;
+    if (book < 1 || chapter < 1) return false;
+    if (Toc* t = toc_for_structure(c)) {
+        // Verses are numbered from 1 in every chapter
+        if (!toc_chapter(t, book, chapter, first, count) || (uint32_t)verse > *count) return false;
+        if (verse > 0) {
+            *first += verse - 1;
+            *count = 1;
+        }
+        return *count > 0;
+    }
+    for (;;) {
+        ensure_books(c, book);
+        if (book > (int)c->books.size()) return false;
+        if (chapter <= (int)c->books[book - 1].nchapters) break;
+        // More chapters can only follow while this is the last book seen
+        if (book < (int)c->books.size() || !xz_step(c)) return false;
+    }
+    size_t g = c->books[book - 1].first_chapter + chapter - 1;
+    ensure_chapter(c, g);
+    uint32_t lo = c->chapter_first[g];
+    uint32_t hi = g + 1 < c->chapter_first.size() ? c->chapter_first[g + 1] : c->nverses;
+    if (verse == 0) {
+        *first = lo;
+        *count = hi - lo;
+        return hi > lo;
+    }
+    for (uint32_t i = lo; i < hi; i++) {
+        if (verse_slot(c, i)->ref.verse() == verse) {
+            *first = i;
+            *count = 1;
+            return true;
+        }
+    }
+    return false;
+}
+
+int Corpus::chapter_count(int book) {
+    Impl* c = impl;
+    if (Toc* t = toc_for_structure(c)) return toc_chapters(t, book);
+    if (book < 1) return 0;
+    // Final once the next book started, or the stream ended
+    ensure_books(c, book + 1);
+    return book <= (int)c->books.size() ? (int)c->books[book - 1].nchapters : 0;
+}
+
+uint32_t Corpus::canonical(uint32_t index) {
+    Impl* c = impl;
+    ensure_verse(c, index);
+    if (index >= c->nverses) return 0;
+    return c->canon ? rd32(c->canon + 4 * index) : verse_slot(c, index)->ref.packed;
+}
+
+// Slots per canonical (book, chapter) up to its highest verse, then one pass
+// to fill them
+static void canon_build(Corpus::Impl* c) {
+    c->canon_chapter.assign(256 * 256 + 1, 0);
+    // IDs out of that range (only in a damaged file) have no slot
+    for (uint32_t i = 0; i < c->nverses; i++) {
+        VerseRef r = { rd32(c->canon + 4 * i) };
+        if (r.chapter() >= 256 || !r.verse()) continue;
+        uint32_t& top = c->canon_chapter[(r.book() << 8 | r.chapter()) + 1];
+        if ((uint32_t)r.verse() > top) top = r.verse();
+    }
+    for (size_t k = 1; k < c->canon_chapter.size(); k++) c->canon_chapter[k] += c->canon_chapter[k - 1];
+    c->canon_local.assign(c->canon_chapter.back(), UINT32_MAX);
+    for (uint32_t i = 0; i < c->nverses; i++) {
+        VerseRef r = { rd32(c->canon + 4 * i) };
+        if (r.chapter() < 256 && r.verse()) c->canon_local[c->canon_chapter[r.book() << 8 | r.chapter()] + r.verse() - 1] = i;
+    }
+}
+
+bool Corpus::find_canonical(uint32_t id, uint32_t* index) {
+    Impl* c = impl;
+    VerseRef r = { id };
+    if (!id || r.chapter() < 1 || r.verse() < 1) return false;
+    if (c->canon) {
+        if (c->canon_chapter.empty()) canon_build(c);
+        if (r.chapter() >= 256) return false;
+        size_t k = r.book() << 8 | r.chapter();
+        uint32_t slot = c->canon_chapter[k] + r.verse() - 1;
+        if (slot >= c->canon_chapter[k + 1] || c->canon_local[slot] == UINT32_MAX) return false;
+        *index = c->canon_local[slot];
+        return true;
+    }
+    // Same versification: verse v of a chapter is nearly always its v-th
+    uint32_t first, count;
+    if (!lookup(r.book(), r.chapter(), 0, &first, &count)) return false;
+    if ((uint32_t)r.verse() <= count && verse_slot(c, first + r.verse() - 1)->ref.packed == id) {
+        *index = first + r.verse() - 1;
+        return true;
+    }
+    if (!lookup(r.book(), r.chapter(), r.verse(), &first, &count)) return false;
+    *index = first;
+    return true;
+}
+
+static bool match_regex(const char* folded, void* re) { return re_match((Regex*)re, folded); }
+
+// Paging calls search again with the same pattern; keep its DFA
+static Regex* regex_for(Corpus::Impl* c, const char* pattern) {
+    if (!c->re || c->re_pattern != pattern) {
+        re_free(c->re);
+        c->re_pattern = pattern;
+        c->re = re_compile(pattern, c->error, sizeof(c->error));
+    }
+    return c->re;
+}
+
+static size_t search_uncached(Corpus::Impl* c, const char* query, int flags, uint32_t after, uint32_t* ids, size_t cap) {
+    if (flags & SEARCH_STEM) {
+        if (strlen(query) >= MAX_LINE) return 0;
+        char q[MAX_LINE * 2];
+        normalize_into(query, q);
+        return stem_find(c, stem_index(c), q, after, ids, cap);
+    }
+    if (flags & SEARCH_REGEX) {
+        if (!regex_for(c, query)) return 0;
+        return shadow_scan(c, match_regex, c->re, re_literal(c->re), after, ids, cap);
+    }
+    if (flags & SEARCH_QUERY) {
+        Query* bq = query_parse(query, c->error, sizeof(c->error));
+        if (bq) {
+            size_t n = query_find(c, bq, flags & SEARCH_WORD, after, ids, cap);
+            query_free(bq);
+            return n;
+        }
+        if (c->error[0]) return 0;
+    }
+    char q[MAX_LINE * 2];
+    normalize_into(query, q);
+    if ((flags & SEARCH_WORD) && words_only(q) && word_index(c)) return tok_find(c->tok, q, after, ids, cap);
+
+    return shadow_find(c, q, flags & SEARCH_WORD, after, ids, cap);
+}
+
+// Cache key: the query as the matcher sees it. Plain text is folded, regex
+// and boolean queries are case sensitive (\W, AND) and only lose extra spaces.
+static std::string cache_key(Corpus::Impl* c, const char* query, int flags) {
+    char k[MAX_LINE * 2 + 16];
+    int n = snprintf(k, 16, "%d\x1f", flags);
+    Query* bq = (flags & SEARCH_QUERY) && !(flags & SEARCH_REGEX) ? query_parse(query, c->error, sizeof(c->error)) : NULL;
+    if ((flags & SEARCH_REGEX) || bq) {
+        std::string key(k, n);
+        for (const char* p = query; *p; p++)
+            if (*p != ' ' || (key.size() > (size_t)n && key[key.size() - 1] != ' ')) key += *p;
+        while (key.size() > (size_t)n && key[key.size() - 1] == ' ') key.erase(key.size() - 1);
+        query_free(bq);
+        return key;
+    }
+    if (strlen(query) >= MAX_LINE) return std::string(k, n) + query;
+    normalize_into(query, k + n);
+    return k;
+}
+
+#define CACHE_BATCH 4096
+
+size_t Corpus::search(const char* query, int flags, uint32_t from, uint32_t* ids, size_t cap) {
+    Impl* c = impl;
+    c->error[0] = 0;
+    c->stats = SearchStats();
+    if (!c->cache) return search_uncached(c, query, flags, from, ids, cap);
+
+    // Whole result list from the cache, or one full search that fills it;
+    // paging then only slices the list
+    std::string key = cache_key(c, query, flags);
+    if (c->error[0]) return 0;
+    if (c->cached_key != key) {
+        c->cached_key.clear();
+        if (!cache_get(c->cache, key, &c->cached_ids)) {
+            c->cached_ids.clear();
+            uint32_t next = 0;
+            for (;;) {
+                size_t have = c->cached_ids.size();
+                c->cached_ids.resize(have + CACHE_BATCH);
+                size_t n = search_uncached(c, query, flags, next, c->cached_ids.data() + have, CACHE_BATCH);
+                c->cached_ids.resize(have + n);
+                if (c->error[0]) return 0;
+                if (n < CACHE_BATCH) break;
+                next = c->cached_ids.back() + 1;
+            }
+            cache_put(c->cache, key, c->cached_ids);
+        }
+        c->cached_key = key;
+    }
+    std::vector<uint32_t>::const_iterator it = std::lower_bound(c->cached_ids.begin(), c->cached_ids.end(), from);
+    size_t n = c->cached_ids.end() - it;
+    if (!ids) return n;
+    n = std::min(n, cap);
+    std::copy(it, it + n, ids);
+    return n;
+}
+
+bool Corpus::set_cache(const char* dir, size_t max_bytes) {
+    Impl* c = impl;
+    cache_close(c->cache);
+    c->cache = NULL;
+    c->cached_key.clear();
+    if (!dir) return true;
+    // Every file a search may read: the source, and the .tok (--word), .stm
+    // (--stem) and .blm (chapter skips) next to it
+    const char* names[] = { c->kind == SRC_VRS ? VRS_FILE : c->kind == SRC_TOK ? TOK_FILE : DATA_FILE, TOK_FILE, STM_FILE, BLM_FILE };
+    char paths[4][MAX_LINE * 2];
+    const char* files[4];
+    for (int i = 0; i < 4; i++) {
+        snprintf(paths[i], sizeof(paths[i]), "%s/%s", c->dir, names[i]);
+        files[i] = paths[i];
+    }
+    c->cache = cache_open(dir, max_bytes, files, 4);
+    return c->cache != NULL;
+}
+
+size_t Corpus::freq(int by, size_t top, WordFreq* out, size_t cap) {
+    impl->error[0] = 0;
+    return freq_top(impl, by, top, out, cap);
+}
+
+size_t Corpus::concordance(const char* word, uint32_t from, WordHit* out, size_t cap) {
+    impl->error[0] = 0;
+    return concordance_find(impl, word, from, out, cap);
+}
+
+size_t Corpus::histogram(const char* query, int flags, int by, HitCount* out, size_t cap) {
+    impl->error[0] = 0;
+    return histogram_count(impl, query, flags, by, out, cap);
+}
+
+const char* Corpus::folded(uint32_t index) {
+    return shadow_extend(impl, index + 1) > index ? impl->shadow.text[index] : NULL;
+}
+
+// Every fold before off shifted the folded text one byte to the left
+static size_t unfold(const uint16_t* lo, const uint16_t* hi, size_t off) {
+    return off + (std::lower_bound(lo, hi, (uint16_t)off) - lo);
+}
+
+size_t Corpus::original_offset(uint32_t index, size_t off) {
+    if (shadow_extend(impl, index + 1) <= index) return off;
+    const Shadow* s = &impl->shadow;
+    return unfold(s->folds.data() + s->fold_first[index], s->folds.data() + s->fold_first[index + 1], off);
+}
+
+static bool by_start(const MatchSpan& a, const MatchSpan& b) { return a.start < b.start || (a.start == b.start && a.end > b.end); }
+
+size_t Corpus::matches(uint32_t index, const char* query, int flags, MatchSpan* out, size_t cap) {
+    Impl* c = impl;
+    c->error[0] = 0;
+    const Verse* v = verse(index);
+    if (!v) return 0;
+    // The folded copy the scan used when the shadow has it; otherwise (token
+    // and paged side file searches) this verse alone is folded once here
+    char buf[MAX_LINE * 2];
+    std::vector<uint16_t> local;
+    const char* folded;
+    const uint16_t *lo, *hi;
+    if (index < c->shadow.text.size()) {
+        folded = c->shadow.text[index];
+        lo = c->shadow.folds.data() + c->shadow.fold_first[index];
+        hi = c->shadow.folds.data() + c->shadow.fold_first[index + 1];
+    } else {
+        if (strlen(v->text) >= MAX_LINE) return 0;
+        normalize_into(v->text, buf, &local);
+        folded = buf;
+        lo = local.data();
+        hi = lo + local.size();
+    }
+
+    std::vector<uint32_t> spans;
+    Query* bq = NULL;
+    if (flags & SEARCH_STEM) {
+        if (strlen(query) >= MAX_LINE) return 0;
+        char q[MAX_LINE * 2];
+        normalize_into(query, q);
+        stem_spans(folded, q, &spans);
+    } else if (flags & SEARCH_REGEX) {
+        if (!regex_for(c, query)) return 0;
+        re_spans(c->re, folded, &spans);
+    } else if ((flags & SEARCH_QUERY) && (bq = query_parse(query, c->error, sizeof(c->error)))) {
+        query_spans(bq, folded, flags & SEARCH_WORD, &spans);
+        query_free(bq);
+    } else {
+        if (c->error[0] || strlen(query) >= MAX_LINE) return 0;
+        char q[MAX_LINE * 2];
+        normalize_into(query, q);
+        term_spans(folded, q, flags & SEARCH_WORD, &spans);
+    }
+
+    // Terms of a boolean query may overlap: sort and merge
+    std::vector<MatchSpan> m;
+    for (size_t i = 0; i + 1 < spans.size(); i += 2) {
+        MatchSpan ms = { (uint32_t)unfold(lo, hi, spans[i]), (uint32_t)unfold(lo, hi, spans[i + 1]) };
+        m.push_back(ms);
+    }
+    std::sort(m.begin(), m.end(), by_start);
+    size_t n = 0;
+    for (size_t i = 0; i < m.size(); i++) {
+        if (n && m[i].start < m[n - 1].end) m[n - 1].end = std::max(m[n - 1].end, m[i].end);
+        else m[n++] = m[i];
+    }
+    for (size_t i = 0; i < n && i < cap; i++) out[i] = m[i];
+    return n;
+}
+
+// From the TOC, or collected from the verses once (which decodes them all)
+static const std::vector<SectionTitle>& all_titles(Corpus* corpus, Corpus::Impl* c) {
+    if (c->toc) return toc_titles(c->toc);
+    if (!c->titles_known) {
+        const Verse* v;
+        for (uint32_t i = 0; (v = corpus->verse(i)); i++) {
+            if (!v->title[0]) continue;
+            SectionTitle s = { i, v->ref, v->title };
+            c->titles.push_back(s);
+        }
+        c->titles_known = true;
+    }
+    return c->titles;
+}
+
+size_t Corpus::titles(int book, int chapter, SectionTitle* out, size_t cap) {
+    const std::vector<SectionTitle>& t = all_titles(this, impl);
+    size_t n = 0;
+    for (size_t i = 0; i < t.size(); i++) {
+        if (book && (t[i].ref.book() != book || (chapter && t[i].ref.chapter() != chapter))) continue;
+        if (n < cap) out[n] = t[i];
+        n++;
+    }
+    return n;
+}
+
+size_t Corpus::find_titles(const char* query, int flags, SectionTitle* out, size_t cap) {
+    Impl* c = impl;
+    c->error[0] = 0;
+    const std::vector<SectionTitle>& t = all_titles(this, c);
+    char q[MAX_LINE * 2];
+    if (flags & SEARCH_REGEX) {
+        if (!regex_for(c, query)) return 0;
+    } else {
+        if (strlen(query) >= MAX_LINE) return 0;
+        normalize_into(query, q);
+    }
+    // Folded once, like the shadow of the verses
+    char buf[MAX_LINE * 2];
+    while (c->titles_folded.size() < t.size()) {
+        const char* title = t[c->titles_folded.size()].title;
+        size_t len = strlen(title) < MAX_LINE ? normalize_into(title, buf) : 0;
+        c->titles_folded.push_back(arena_dup(&c->arena, buf, len));
+    }
+    size_t n = 0;
+    for (size_t i = 0; i < t.size(); i++) {
+        const char* f = c->titles_folded[i];
+        bool hit = (flags & SEARCH_REGEX) ? re_match(c->re, f) : (flags & SEARCH_WORD) ? word_match(f, q) : strstr(f, q) != NULL;
+        if (!hit) continue;
+        if (n < cap) out[n] = t[i];
+        n++;
+    }
+    return n;
+}
+
+uint32_t Corpus::count(const char* query, int flags, uint32_t from) {
+    return (uint32_t)search(query, flags, from, NULL, 0);
+}
+
+const char* Corpus::error() { return impl->error[0] ? impl->error : NULL; }
+
+const SearchStats* Corpus::stats() { return &impl->stats; }
@@ -0,0 +1,175 @@
+#ifndef BIBLE_CORPUS_H
+#define BIBLE_CORPUS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Embeddable corpus library. A Corpus is opened once over a data directory
+// (bible_data.txt.xz, plus the optional bible_data.vrs / bible_data.tok /
+// bible_data.toc side files) and answers lookups and searches with pointers into its own memory.
+// Nothing returned needs freeing; it stays valid until close().
+//
+// Not thread safe while loading: verses are materialized on first use. Call
+// load() once before sharing a Corpus between threads.
+
+// Book (1-66) in the top 8 bits, chapter and verse in 12 bits each
+struct VerseRef {
+    uint32_t packed;
+
+    static VerseRef make(int book, int chapter, int verse) {
+        VerseRef r = { ((uint32_t)book << 24) | ((uint32_t)chapter << 12) | (uint32_t)verse };
+        return r;
+    }
+    int book() const { return packed >> 24; }
+    int chapter() const { return (packed >> 12) & 0xFFF; }
+    int verse() const { return packed & 0xFFF; }
+};
+
+struct Verse {
+    VerseRef ref;
+    const char* title; // section title starting at this verse, "" if none
+    const char* text;  // verse text, still with the <span class='Isus'> markup
+    const char* refs;  // cross references "Ioan 1.1;Evr 1.10", "" if none
+};
+
+// Search flags
+#define SEARCH_WORD 1  // whole words / phrases instead of substrings
+#define SEARCH_REGEX 2 // query is a regular expression over the folded text
+#define SEARCH_QUERY 4 // query may use AND / OR / NOT, ( ) and in: / ot: / nt: filters
+#define SEARCH_STEM 8  // every query word matches words with the same (light Romanian) stem
+
+// Word frequency (Corpus::freq): word points into the folded text, len bytes
+struct WordFreq {
+    int group;         // 0 overall, book 1-66 or testament 1 (old) / 2 (new)
+    const char* word;
+    uint32_t len;
+    uint32_t count;
+};
+
+// Concordance hit (Corpus::concordance): byte offset in folded(index)
+struct WordHit {
+    uint32_t index;
+    uint32_t offset;
+};
+
+// Match in a verse (Corpus::matches): [start, end) byte offsets in verse->text
+struct MatchSpan {
+    uint32_t start;
+    uint32_t end;
+};
+
+// Section title (Corpus::titles / find_titles) and the verse it starts at
+struct SectionTitle {
+    uint32_t index;
+    VerseRef ref;
+    const char* title;
+};
+
+// Matches of one book (chapter 0) or one chapter (Corpus::histogram)
+struct HitCount {
+    VerseRef ref;      // verse 0
+    uint32_t verses;   // verses that match
+    uint32_t hits;     // matches in them, counted like Corpus::matches spans
+};
+
+// Work of the last search / count (Corpus::stats)
+struct SearchStats {
+    uint32_t chapters; // chapters checked against the bible_data.blm filters
+    uint32_t skipped;  // of them, ruled out without decoding a verse
+};
+
+// histogram groupings
+#define HIST_BOOK 0
+#define HIST_CHAPTER 1
+
+// freq groupings
+#define FREQ_ALL 0
+#define FREQ_BOOK 1
+#define FREQ_TESTAMENT 2
+
+class Corpus {
+public:
+    Corpus();
+    ~Corpus();
+
+    // dir holds bible_data.txt.xz (and the optional side files)
+    bool open(const char* dir);
+    void close();
+
+    // Materializes every verse up front
+    void load();
+
+    uint32_t size();                    // number of verses
+    const Verse* verse(uint32_t index); // 0-based, NULL past the end
+
+    int book_count();
+    const char* book_name(int book);    // 1-based
+    int find_book(const char* name);    // case insensitive, 0 if unknown
+    int chapter_count(int book);        // 0 if unknown
+
+    // Verse range of book/chapter, or of a single verse when verse > 0
+    bool lookup(int book, int chapter, int verse, uint32_t* first, uint32_t* count);
+
+    // Stores up to cap matching verse indexes >= from in ids (in corpus
+    // order) and returns how many were stored. The scan stops at the cap, so
+    // asking for one more than a page tells whether another page exists.
+    size_t search(const char* query, int flags, uint32_t from, uint32_t* ids, size_t cap);
+    uint32_t count(const char* query, int flags, uint32_t from);
+    // Keeps whole result lists on disk in dir (created if missing), at most
+    // max_bytes of them, least recently used out first; shared safely by
+    // concurrent processes. Later searches are answered from it. NULL turns
+    // it off; false if dir is unusable.
+    bool set_cache(const char* dir, size_t max_bytes);
+    // Why the last search found nothing because of its query (bad regex), or NULL
+    const char* error();
+    // What the last search / count scanned; all 0 when it was answered from
+    // the cache or an index without a scan
+    const SearchStats* stats();
+
+    // Top words of the folded text, overall or per book / testament: up to
+    // top entries per group, groups in order, most frequent first. Stores at
+    // most cap entries in out and returns how many. Runs on all cores.
+    size_t freq(int by, size_t top, WordFreq* out, size_t cap);
+    // Every occurrence of a single word in verses >= from, in corpus order.
+    // Returns the total; stores up to cap of them when out is not NULL.
+    size_t concordance(const char* word, uint32_t from, WordHit* out, size_t cap);
+    // Every match of query (same flags as search, no cap) counted per book
+    // or per chapter: the groups with a matching verse, in order. Returns
+    // how many, stores up to cap. Whole books are counted on all cores.
+    size_t histogram(const char* query, int flags, int by, HitCount* out, size_t cap);
+
+    // Section titles of book (0: every book), of one chapter unless chapter
+    // is 0, in order. Returns the total, stores up to cap. With
+    // bible_data.toc these (and the book / chapter structure) come from it
+    // and no verse is decoded.
+    size_t titles(int book, int chapter, SectionTitle* out, size_t cap);
+    // Titles the query matches, folded like verse searches: a substring,
+    // whole words (SEARCH_WORD) or a regex (SEARCH_REGEX). Same contract.
+    size_t find_titles(const char* query, int flags, SectionTitle* out, size_t cap);
+
+    // Canonical verse ID (packed like VerseRef) shared by all translations,
+    // 0 if the verse has none. Translations built with `extractor -canon`
+    // map their versification onto the one of bible_data.txt.
+    uint32_t canonical(uint32_t index);
+    // Verse with canonical ID id by direct index, false if this text lacks it
+    bool find_canonical(uint32_t id, uint32_t* index);
+
+    // Lowercased, diacritic folded text of a verse, as searches see it
+    const char* folded(uint32_t index);
+    // Byte offset in verse(index)->text of byte offset off in folded(index)
+    size_t original_offset(uint32_t index, size_t off);
+    // Where query (same flags as search) matches verse(index), as byte spans
+    // of its original text in order, merged where they overlap. Found in the
+    // folded copy the search used, mapped back through the folds. Returns the
+    // number of spans, stores up to cap.
+    size_t matches(uint32_t index, const char* query, int flags, MatchSpan* out, size_t cap);
+
+    struct Impl;
+
+private:
+    Impl* impl;
+    Corpus(const Corpus&);
+    Corpus& operator=(const Corpus&);
+};
+
+#endif
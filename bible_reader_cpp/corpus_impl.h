@@ -0,0 +1,251 @@
+#ifndef BIBLE_CORPUS_IMPL_H
+#define BIBLE_CORPUS_IMPL_H
+
+// Internals shared by the corpus sources. Not part of the library API.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <string>
+#include "corpus.h"
+
+#define MAX_LINE 4096
+#define DATA_FILE "bible_data.txt.xz"
+#define TOK_FILE "bible_data.tok"
+#define VRS_FILE "bible_data.vrs"
+#define TOC_FILE "bible_data.toc"
+#define STM_FILE "bible_data.stm"
+#define BLM_FILE "bible_data.blm"
+// Decoder ring defaults, overridable with BIBLE_CHUNK_KB / BIBLE_RING_CHUNKS
+#define CHUNK_KB 256
+#define RING_CHUNKS 4
+// Multi-block .xz: decoder threads (BIBLE_DECODE_THREADS, default one per
+// core) and blocks decoded ahead of the parser (BIBLE_BLOCKS_IN_FLIGHT)
+#define DECODE_MAX_THREADS 16
+
+// Lowercases and folds Romanian diacritics into out (MAX_LINE * 2 bytes).
+// folds, if given, gets the output offset of every 2 byte letter folded to 1.
+size_t normalize_into(const char* str, char* out, std::vector<uint16_t>* folds = NULL);
+bool word_match(const char* text, const char* q);
+// Occurrences of q in folded text outside the markup as start, end pairs
+void term_spans(const char* text, const char* q, bool whole_word, std::vector<uint32_t>* spans);
+bool is_word_byte(unsigned char c);
+uint32_t rd32(const unsigned char* p);
+
+// Bump allocator; strings never move, so verses can point into it
+struct Arena {
+    std::vector<char*> blocks;
+    char* p;
+    size_t left;
+};
+char* arena_dup(Arena* a, const char* s, size_t n);
+void arena_free(Arena* a);
+
+// xz stream source (stream.cpp): a decoder thread feeding a line reader
+struct XzStream;
+XzStream* xz_open(const char* path);
+char* xz_line(XzStream* xs);   // next NUL terminated line, NULL at the end; stays valid until the call after next
+void xz_close(XzStream* xs);   // stops the decoder without draining it
+
+// Word-token corpus (tokens.cpp)
+struct TokCorpus;
+struct TokVerse {
+    uint64_t title_bit, verse_bit, refs_bit; // line starts, UINT64_MAX if none
+};
+TokCorpus* tok_open(const char* path);
+void tok_close(TokCorpus* t);
+// Walks the token stream once and fills the structure and line offsets
+void tok_index(TokCorpus* t, Corpus::Impl* c, std::vector<TokVerse>* out);
+void tok_materialize(TokCorpus* t, const TokVerse* tv, Verse* v, Arena* a);
+// Verse text decoded into buf (MAX_LINE bytes), for scans that keep nothing
+const char* tok_text(TokCorpus* t, const TokVerse* tv, char* buf);
+// Whole word / phrase search over token IDs; ids may be NULL to only count
+size_t tok_find(TokCorpus* t, const char* query_norm, uint32_t after, uint32_t* ids, size_t cap);
+
+// Per-verse FSST store (verses.cpp)
+struct VerseStore;
+VerseStore* vs_open(const char* path);
+void vs_close(VerseStore* vs);
+void vs_index(VerseStore* vs, Corpus::Impl* c);
+void vs_materialize(VerseStore* vs, uint32_t index, Verse* v, Arena* a);
+const char* vs_text(VerseStore* vs, uint32_t index, char* buf); // buf: MAX_LINE * 2 + 8
+const unsigned char* vs_canon(VerseStore* vs); // u32 canonical IDs per verse, NULL in version 1
+
+// Table of contents (toc.cpp)
+struct Toc;
+Toc* toc_open(const char* path);
+void toc_close(Toc* t);
+int toc_books(Toc* t);
+const char* toc_book_name(Toc* t, int book); // 1-based
+int toc_chapters(Toc* t, int book);
+bool toc_chapter(Toc* t, int book, int chapter, uint32_t* first, uint32_t* count);
+const std::vector<SectionTitle>& toc_titles(Toc* t);
+
+struct BookInfo {
+    const char* name;
+    uint32_t first_chapter; // index into chapter_first
+    uint32_t nchapters;
+};
+
+// Folded shadow of the verse texts (shadow.cpp)
+struct ShadowBlock {
+    char* data;
+    size_t used, cap;
+    uint32_t first;                       // first verse in the block
+};
+struct Shadow {
+    std::vector<ShadowBlock> blocks;
+    std::vector<const char*> text;        // folded text per verse covered so far
+    std::vector<uint32_t> fold_first;     // per verse start in folds, +1 sentinel
+    std::vector<uint16_t> folds;          // folded offsets where 2 bytes became 1
+};
+
+struct Regex;
+struct Query;
+struct StemIndex;
+struct BloomIndex;
+struct ResultCache;
+
+enum SourceKind { SRC_XZ, SRC_TOK, SRC_VRS };
+
+#define VERSE_PAGE 4096
+
+struct Corpus::Impl {
+    SourceKind kind;
+    char dir[MAX_LINE];
+    Arena arena;
+    std::vector<Verse*> pages;            // VERSE_PAGE entries each, never moved
+    uint32_t nverses;
+    std::vector<BookInfo> books;
+    std::vector<uint32_t> chapter_first;  // first verse index of every chapter
+    bool complete;                        // whole structure known
+
+    // Stream parsing state
+    XzStream* xz;
+    const char* pending_title;
+    int chapter;
+    bool last_was_verse;                  // an R line may still follow
+
+    TokCorpus* tok;                       // also used for SEARCH_WORD
+    bool tok_tried;
+    std::vector<TokVerse> tok_verses;
+    VerseStore* vrs;
+    StemIndex* stm;                       // opened by the first --stem search
+    bool stm_tried;
+    BloomIndex* blm;                      // opened by the first literal scan
+    bool blm_tried;
+    SearchStats stats;                    // of the last search, summed over its scans
+
+    // Other versification: canonical ID per verse (vrs version 2), NULL if
+    // it is the one of bible_data.txt, and the direct index back
+    const unsigned char* canon;
+    std::vector<uint32_t> canon_chapter;  // (book << 8 | chapter) -> first slot in canon_local
+    std::vector<uint32_t> canon_local;    // verse index per canonical verse, UINT32_MAX if none
+
+    // Structure and titles without decoding, NULL without bible_data.toc;
+    // otherwise titles are collected from the verses once
+    Toc* toc;
+    bool titles_known;
+    std::vector<SectionTitle> titles;
+    std::vector<const char*> titles_folded;
+
+    Shadow shadow;
+
+    std::string re_pattern;               // last compiled --regex pattern
+    Regex* re;
+    char error[256];
+
+    ResultCache* cache;                   // NULL unless set_cache()
+    std::string cached_key;               // whole result list of the last query
+    std::vector<uint32_t> cached_ids;
+};
+
+Verse* add_verse(Corpus::Impl* c, VerseRef ref);
+void add_book(Corpus::Impl* c, const char* name, size_t len);
+void add_chapter(Corpus::Impl* c);
+void ensure_verse(Corpus::Impl* c, uint32_t i);  // parse the stream up to verse i
+void ensure_books(Corpus::Impl* c, size_t n);    // ... until n books are known
+void ensure_chapter(Corpus::Impl* c, size_t g);  // ... until chapter g (global index) is final
+// Original verse text, decoded into buf (MAX_LINE * 2 + 8) if the source needs it
+const char* scan_text(Corpus::Impl* c, uint32_t i, char* buf);
+
+// Covers verses up to (not including) upto where they exist; returns how many are covered
+uint32_t shadow_extend(Corpus::Impl* c, uint32_t upto);
+void shadow_free(Shadow* s);
+// Substring / whole word scan over the shadow, same contract as Corpus::search
+size_t shadow_find(Corpus::Impl* c, const char* query_norm, bool whole_word, uint32_t after, uint32_t* ids, size_t cap);
+// Verse by verse scan with any matcher over the folded text. Verses without
+// the literal must (if not NULL or "") are skipped by memmem; match NULL
+// accepts every verse left.
+size_t shadow_scan(Corpus::Impl* c, bool (*match)(const char* folded, void* arg), void* arg, const char* must,
+                   uint32_t after, uint32_t* ids, size_t cap);
+
+// Per-chapter trigram filters (bloom.cpp)
+BloomIndex* blm_open(const char* path);
+void blm_close(BloomIndex* bi);
+uint32_t blm_verses(BloomIndex* bi);
+BloomIndex* bloom_index(Corpus::Impl* c);   // NULL without a usable bible_data.blm
+// Distinct trigram hashes of a folded literal the filters know; 0 if it has none
+size_t blm_trigrams(const char* literal, std::vector<uint32_t>* out);
+// shadow_scan with must, skipping the chapters whose filter lacks one of the
+// trigrams; verses the shadow does not cover are folded one by one
+size_t bloom_scan(Corpus::Impl* c, BloomIndex* bi, const std::vector<uint32_t>& trigrams,
+                  bool (*match)(const char* folded, void* arg), void* arg, const char* must,
+                  uint32_t after, uint32_t* ids, size_t cap);
+
+// Lazy DFA regex over folded text (regex.cpp)
+Regex* re_compile(const char* pattern, char* err, size_t errlen); // NULL and err on a bad pattern
+bool re_match(Regex* re, const char* folded);
+const char* re_literal(Regex* re);  // a word every match contains, "" if none known
+// Leftmost-longest matches in folded text as start, end offset pairs; returns how many
+size_t re_spans(Regex* re, const char* folded, std::vector<uint32_t>* spans);
+void re_free(Regex* re);
+
+// Light Romanian stemmer and stem index (stem.cpp)
+size_t stem_word(const char* w, size_t len);  // length of the stem of folded word w
+StemIndex* stm_open(const char* path);
+void stm_close(StemIndex* si);
+uint32_t stm_verses(StemIndex* si);
+// Verses holding every query word's stem, same contract as Corpus::search;
+// from the posting lists of si, or by scanning the shadow when it is NULL
+size_t stem_find(Corpus::Impl* c, StemIndex* si, const char* query_norm, uint32_t after, uint32_t* ids, size_t cap);
+// Distinct stems of the query words, at most 32
+void query_stems(const char* query_norm, std::vector<std::string>* stems);
+// Every stem among the stems of the verse's words; spans, if given, gets the
+// words that have one as start, end pairs
+bool stems_in(const char* folded, const std::vector<std::string>& stems, std::vector<uint32_t>* spans);
+// Words of folded text sharing a stem with a query word, as start, end pairs
+void stem_spans(const char* folded, const char* query_norm, std::vector<uint32_t>* spans);
+
+// Boolean queries with book / chapter / testament filters (query.cpp)
+typedef std::vector<std::pair<uint32_t, uint32_t> > Ranges; // [lo, hi) verses
+// NULL with err[0] == 0 when the text is a plain phrase for the usual paths
+Query* query_parse(const char* text, char* err, size_t errlen);
+// Same contract as Corpus::search; only verses inside the filters are decoded
+size_t query_find(Corpus::Impl* c, Query* q, bool whole_word, uint32_t after, uint32_t* ids, size_t cap);
+// Resolves the filters (c->error if one names nothing) into the verse ranges
+// the query can match at all; the last one may end at UINT32_MAX
+bool query_plan(Corpus::Impl* c, Query* q, Ranges* scope);
+// Whether verse i with folded text matches, once the filters are resolved
+bool query_match(const Query* q, uint32_t i, const char* folded, bool whole_word);
+// Occurrences of the terms a match rests on (not those under NOT), unsorted
+void query_spans(const Query* q, const char* folded, bool whole_word, std::vector<uint32_t>* spans);
+void query_free(Query* q);
+
+// On-disk result cache (cache.cpp); every key includes a hash of the nfiles
+// files a search may read: files[0] is the source and must exist, the side
+// files (.tok, .stm, .blm) after it may be missing
+ResultCache* cache_open(const char* dir, size_t max_bytes, const char* const* files, int nfiles);
+void cache_close(ResultCache* rc);
+bool cache_get(ResultCache* rc, const std::string& key, std::vector<uint32_t>* ids);
+void cache_put(ResultCache* rc, const std::string& key, const std::vector<uint32_t>& ids);
+
+// Parallel word counts and concordance over the shadow (freq.cpp)
+// Next word of folded text at or after p, NULL at the end: letters and
+// digits (multibyte letters too), „ ” – … (E2 xx xx) and markup between
+const char* next_word(const char* p, uint32_t* len);
+size_t freq_top(Corpus::Impl* c, int by, size_t top, WordFreq* out, size_t cap);
+size_t concordance_find(Corpus::Impl* c, const char* word, uint32_t after, WordHit* out, size_t cap);
+size_t histogram_count(Corpus::Impl* c, const char* query, int flags, int by, HitCount* out, size_t cap);
+
+#endif
@@ -0,0 +1,401 @@
+// Word frequencies and concordance over the folded shadow text. The shadow is
+// completed once (the sources only decode sequentially), then the verses are
+// split into one contiguous slice per core: every thread tokenizes its slice
+// into its own open addressing table (or hit list), and the slices are merged
+// at the end in corpus order. Hit histograms hand out whole books instead,
+// so every thread counts into the chapters of its own books.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <pthread.h>
+#include <unistd.h>
+#include "corpus_impl.h"
+
+#define FREQ_MAX_THREADS 16
+#define FREQ_MIN_SLICE 2048   // verses; smaller slices are not worth a thread
+#define OT_BOOKS 39
+
+struct WordSlot {
+    const char* word;         // into the shadow, not NUL terminated
+    uint32_t len, hash;
+    uint32_t group, count;
+};
+
+// Open addressing, linear probing, kept at most half full
+struct WordTable {
+    WordSlot* slots;
+    uint32_t mask, used;
+};
+
+static void table_init(WordTable* t, uint32_t cap) {
+    t->slots = (WordSlot*)calloc(cap, sizeof(WordSlot));
+    t->mask = cap - 1;
+    t->used = 0;
+}
+
+static WordSlot* table_slot(WordTable* t, const char* w, uint32_t len, uint32_t hash, uint32_t group) {
+    for (uint32_t i = hash & t->mask;; i = (i + 1) & t->mask) {
+        WordSlot* s = &t->slots[i];
+        if (!s->word) return s;
+        if (s->hash == hash && s->group == group && s->len == len && memcmp(s->word, w, len) == 0) return s;
+    }
+}
+
+static void table_add(WordTable* t, const char* w, uint32_t len, uint32_t hash, uint32_t group, uint32_t n);
+
+static void table_grow(WordTable* t) {
+    WordTable bigger;
+    table_init(&bigger, (t->mask + 1) * 2);
+    for (uint32_t i = 0; i <= t->mask; i++) {
+        const WordSlot* s = &t->slots[i];
+        if (s->word) table_add(&bigger, s->word, s->len, s->hash, s->group, s->count);
+    }
+    free(t->slots);
+    *t = bigger;
+}
+
+static void table_add(WordTable* t, const char* w, uint32_t len, uint32_t hash, uint32_t group, uint32_t n) {
+    WordSlot* s = table_slot(t, w, len, hash, group);
+    if (!s->word) {
+        if ((t->used + 1) * 2 > t->mask + 1) {
+            table_grow(t);
+            s = table_slot(t, w, len, hash, group);
+        }
+        s->word = w; s->len = len; s->hash = hash; s->group = group;
+        t->used++;
+    }
+    s->count += n;
+}
+
+// FNV-1a, mixed with the group so per book tables spread too
+static uint32_t word_hash(const char* w, uint32_t len, uint32_t group) {
+    uint32_t h = 2166136261u ^ (group * 0x9E3779B9u);
+    for (uint32_t i = 0; i < len; i++) h = (h ^ (unsigned char)w[i]) * 16777619u;
+    return h;
+}
+
+// Byte classes for the tokenizer: letters/digits (multibyte letters too)
+// make words; „ ” – … (E2 xx xx) and the <span> markup separate them, like
+// word_match and the extractor's tokenizer
+enum { B_SEP, B_WORD, B_TAG, B_PUNCT, B_END };
+static unsigned char byte_class[256];
+
+static void init_classes() {
+    for (int ch = 0; ch < 256; ch++) byte_class[ch] = is_word_byte(ch) ? B_WORD : B_SEP;
+    byte_class[0] = B_END;
+    byte_class['<'] = B_TAG;
+    byte_class[0xE2] = B_PUNCT;
+}
+
+const char* next_word(const char* p, uint32_t* len) {
+    if (!byte_class[0]) init_classes();
+    for (;;) {
+        switch (byte_class[(unsigned char)*p]) {
+        case B_END:
+            return NULL;
+        case B_TAG:
+            while (*p && *p != '>') p++;
+            if (*p) p++;
+            break;
+        case B_PUNCT:
+            p++;
+            while (((unsigned char)*p & 0xC0) == 0x80) p++;
+            break;
+        case B_SEP:
+            p++;
+            break;
+        default: {
+            const char* w = p;
+            while (byte_class[(unsigned char)*p] == B_WORD) p++;
+            *len = p - w;
+            return w;
+        }
+        }
+    }
+}
+
+struct Slice {
+    const Corpus::Impl* c;
+    const uint32_t* book_first;  // first verse of every book, +1 sentinel
+    int by;
+    uint32_t lo, hi;             // verses
+    // freq
+    WordTable table;
+    // concordance
+    const char* word;
+    size_t wlen;
+    std::vector<WordHit> hits;
+};
+
+static int group_of(int by, int book) {
+    if (by == FREQ_BOOK) return book;
+    if (by == FREQ_TESTAMENT) return book <= OT_BOOKS ? 1 : 2;
+    return 0;
+}
+
+static void* count_slice(void* arg) {
+    Slice* s = (Slice*)arg;
+    table_init(&s->table, s->by == FREQ_BOOK ? 1 << 17 : 1 << 15);
+    int book = std::upper_bound(s->book_first, s->book_first + s->c->books.size(), s->lo) - s->book_first;
+    for (uint32_t i = s->lo; i < s->hi; i++) {
+        while (i >= s->book_first[book]) book++;
+        uint32_t group = group_of(s->by, book), len;
+        for (const char* w = next_word(s->c->shadow.text[i], &len); w; w = next_word(w + len, &len))
+            table_add(&s->table, w, len, word_hash(w, len, group), group, 1);
+    }
+    return NULL;
+}
+
+static void* find_slice(void* arg) {
+    Slice* s = (Slice*)arg;
+    for (uint32_t i = s->lo; i < s->hi; i++) {
+        const char* text = s->c->shadow.text[i];
+        if (!strstr(text, s->word)) continue;
+        uint32_t len;
+        for (const char* w = next_word(text, &len); w; w = next_word(w + len, &len)) {
+            if (len != s->wlen || memcmp(w, s->word, len) != 0) continue;
+            WordHit h = { i, (uint32_t)(w - text) };
+            s->hits.push_back(h);
+        }
+    }
+    return NULL;
+}
+
+// Completes the shadow and runs fn over [after, nverses) in parallel slices
+static void run_slices(Corpus::Impl* c, const Slice& proto, std::vector<Slice>* slices, void* (*fn)(void*), uint32_t after) {
+    uint32_t n = shadow_extend(c, UINT32_MAX);
+    std::vector<uint32_t> book_first;
+    for (size_t b = 0; b < c->books.size(); b++) book_first.push_back(c->chapter_first[c->books[b].first_chapter]);
+    book_first.push_back(UINT32_MAX);
+
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t span = after < n ? n - after : 0;
+    size_t nt = std::max(1L, std::min((long)FREQ_MAX_THREADS, std::min(cores, (long)(span / FREQ_MIN_SLICE))));
+    slices->assign(nt, proto);
+    pthread_t tid[FREQ_MAX_THREADS];
+    for (size_t t = 0; t < nt; t++) {
+        Slice* s = &(*slices)[t];
+        s->c = c;
+        s->book_first = book_first.data();
+        s->lo = after + (uint64_t)span * t / nt;
+        s->hi = after + (uint64_t)span * (t + 1) / nt;
+        if (t) pthread_create(&tid[t], NULL, fn, s);
+    }
+    fn(&(*slices)[0]);
+    for (size_t t = 1; t < nt; t++) pthread_join(tid[t], NULL);
+}
+
+static bool by_count(const WordSlot& a, const WordSlot& b) {
+    if (a.count != b.count) return a.count > b.count;
+    int d = memcmp(a.word, b.word, std::min(a.len, b.len));
+    return d ? d < 0 : a.len < b.len;
+}
+
+size_t freq_top(Corpus::Impl* c, int by, size_t top, WordFreq* out, size_t cap) {
+    std::vector<Slice> slices;
+    Slice proto = Slice();
+    proto.by = by;
+    run_slices(c, proto, &slices, count_slice, 0);
+
+    // Merge into the first table, then rank every group
+    WordTable* all = &slices[0].table;
+    for (size_t t = 1; t < slices.size(); t++) {
+        WordTable* tt = &slices[t].table;
+        for (uint32_t i = 0; i <= tt->mask; i++) {
+            const WordSlot* s = &tt->slots[i];
+            if (s->word) table_add(all, s->word, s->len, s->hash, s->group, s->count);
+        }
+        free(tt->slots);
+    }
+    // Bucket by group, then only the top of every bucket gets sorted
+    std::vector<std::vector<WordSlot> > groups;
+    for (uint32_t i = 0; i <= all->mask; i++) {
+        const WordSlot* s = &all->slots[i];
+        if (!s->word) continue;
+        if (s->group >= groups.size()) groups.resize(s->group + 1);
+        groups[s->group].push_back(*s);
+    }
+    free(all->slots);
+
+    size_t n = 0;
+    for (size_t g = 0; g < groups.size(); g++) {
+        std::vector<WordSlot>& w = groups[g];
+        size_t k = std::min(top, w.size());
+        std::partial_sort(w.begin(), w.begin() + k, w.end(), by_count);
+        for (size_t i = 0; i < k && n < cap; i++) {
+            WordFreq f = { (int)w[i].group, w[i].word, w[i].len, w[i].count };
+            out[n++] = f;
+        }
+    }
+    return n;
+}
+
+size_t concordance_find(Corpus::Impl* c, const char* word, uint32_t after, WordHit* out, size_t cap) {
+    char q[MAX_LINE * 2];
+    if (strlen(word) >= MAX_LINE) return 0;
+    normalize_into(word, q);
+    uint32_t len;
+    const char* w = next_word(q, &len);
+    if (!w || next_word(w + len, &len)) {
+        snprintf(c->error, sizeof(c->error), "concordance takes a single word");
+        return 0;
+    }
+    std::vector<Slice> slices;
+    Slice proto = Slice();
+    q[w - q + len] = 0;
+    proto.word = w;
+    proto.wlen = len;
+    run_slices(c, proto, &slices, find_slice, after);
+    size_t n = 0;
+    for (size_t t = 0; t < slices.size(); t++) {
+        for (size_t i = 0; i < slices[t].hits.size(); i++, n++)
+            if (out && n < cap) out[n] = slices[t].hits[i];
+    }
+    return n;
+}
+
+// Histogram: the query prepared once, one worker per thread
+struct HistJob {
+    const Corpus::Impl* c;
+    int flags;
+    const char* q;                          // folded query, or the --regex pattern
+    const char* must;                       // literal every matching verse holds, "" if none
+    std::vector<std::string> stems;         // --stem
+    Query* bq;                              // boolean query, filters resolved
+    Ranges scope;
+    std::vector<HitCount> chapters;         // one per chapter
+    std::atomic<int> next_book;
+};
+
+struct HistWorker {
+    HistJob* job;
+    Regex* re;                              // the DFA grows while matching, one each
+    std::vector<uint32_t> spans;
+};
+
+static bool span_less(const std::pair<uint32_t, uint32_t>& a, const std::pair<uint32_t, uint32_t>& b) {
+    return a.first < b.first || (a.first == b.first && a.second > b.second);
+}
+
+// Matches of verse i (false if it does not match), overlapping spans merged
+static bool verse_hits(HistWorker* w, uint32_t i, const char* folded, uint32_t* hits) {
+    const HistJob* j = w->job;
+    bool word = j->flags & SEARCH_WORD;
+    std::vector<uint32_t>& spans = w->spans;
+    spans.clear();
+    if (j->flags & SEARCH_STEM) {
+        if (!stems_in(folded, j->stems, &spans)) return false;
+    } else if (w->re) {
+        if (!re_match(w->re, folded)) return false;
+        re_spans(w->re, folded, &spans);
+    } else if (j->bq) {
+        if (!query_match(j->bq, i, folded, word)) return false;
+        query_spans(j->bq, folded, word, &spans);
+    } else {
+        if (word ? !word_match(folded, j->q) : !strstr(folded, j->q)) return false;
+        term_spans(folded, j->q, word, &spans);
+    }
+    if (!j->bq) {
+        *hits = spans.size() / 2;
+        return true;
+    }
+    // Terms of a boolean query may overlap
+    std::vector<std::pair<uint32_t, uint32_t> > m;
+    for (size_t k = 0; k + 1 < spans.size(); k += 2) m.push_back(std::make_pair(spans[k], spans[k + 1]));
+    std::sort(m.begin(), m.end(), span_less);
+    uint32_t n = 0, end = 0;
+    for (size_t k = 0; k < m.size(); k++) {
+        if (n && m[k].first < end) end = std::max(end, m[k].second);
+        else { n++; end = m[k].second; }
+    }
+    *hits = n;
+    return true;
+}
+
+static void* hist_books(void* arg) {
+    HistWorker* w = (HistWorker*)arg;
+    HistJob* j = w->job;
+    const Corpus::Impl* c = j->c;
+    for (int b; (b = j->next_book++) < (int)c->books.size();) {
+        const BookInfo* bi = &c->books[b];
+        uint32_t g = bi->first_chapter, last = g + bi->nchapters - 1;
+        uint32_t lo = c->chapter_first[g], hi = last + 1 < c->chapter_first.size() ? c->chapter_first[last + 1] : c->nverses;
+        for (size_t r = 0; r < j->scope.size(); r++) {
+            for (uint32_t i = std::max(lo, j->scope[r].first); i < std::min(hi, j->scope[r].second); i++) {
+                const char* folded = c->shadow.text[i];
+                uint32_t hits;
+                if (*j->must && !strstr(folded, j->must)) continue;
+                if (!verse_hits(w, i, folded, &hits)) continue;
+                while (g < last && c->chapter_first[g + 1] <= i) g++;
+                j->chapters[g].verses++;
+                j->chapters[g].hits += hits;
+            }
+        }
+    }
+    return NULL;
+}
+
+size_t histogram_count(Corpus::Impl* c, const char* query, int flags, int by, HitCount* out, size_t cap) {
+    HistJob job;
+    job.c = c;
+    job.flags = flags;
+    job.must = "";
+    job.bq = NULL;
+    job.next_book = 0;
+    char q[MAX_LINE * 2];
+    if (strlen(query) >= MAX_LINE) return 0;
+    normalize_into(query, q);
+    job.q = flags & SEARCH_REGEX ? query : q;
+    shadow_extend(c, UINT32_MAX);
+    job.scope.push_back(std::make_pair(0u, c->nverses));
+
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t nt = std::max(1L, std::min((long)FREQ_MAX_THREADS, std::min(cores, (long)c->books.size())));
+    HistWorker w[FREQ_MAX_THREADS];
+    for (size_t t = 0; t < nt; t++) {
+        w[t].job = &job;
+        w[t].re = NULL;
+    }
+    bool ok = true;
+    if (flags & SEARCH_STEM) {
+        query_stems(q, &job.stems);
+        ok = !job.stems.empty();
+        // The longest stem is a prefix of a word of every match
+        for (size_t k = 0; k < job.stems.size(); k++)
+            if (job.stems[k].size() > strlen(job.must)) job.must = job.stems[k].c_str();
+    } else if (flags & SEARCH_REGEX) {
+        for (size_t t = 0; t < nt && ok; t++) ok = (w[t].re = re_compile(query, c->error, sizeof(c->error))) != NULL;
+        if (ok) job.must = re_literal(w[0].re);
+    } else if (flags & SEARCH_QUERY) {
+        job.bq = query_parse(query, c->error, sizeof(c->error));
+        ok = job.bq ? query_plan(c, job.bq, &job.scope) : !c->error[0];
+    }
+
+    size_t n = 0;
+    if (ok) {
+        job.chapters.assign(c->chapter_first.size(), HitCount());
+        pthread_t tid[FREQ_MAX_THREADS];
+        for (size_t t = 1; t < nt; t++) pthread_create(&tid[t], NULL, hist_books, &w[t]);
+        hist_books(&w[0]);
+        for (size_t t = 1; t < nt; t++) pthread_join(tid[t], NULL);
+
+        for (size_t b = 0; b < c->books.size(); b++) {
+            HitCount sum = HitCount();
+            sum.ref = VerseRef::make(b + 1, 0, 0);
+            for (uint32_t ch = 0; ch < c->books[b].nchapters; ch++) {
+                HitCount h = job.chapters[c->books[b].first_chapter + ch];
+                h.ref = VerseRef::make(b + 1, ch + 1, 0);
+                sum.verses += h.verses;
+                sum.hits += h.hits;
+                if (by == HIST_CHAPTER && h.verses && n++ < cap) out[n - 1] = h;
+            }
+            if (by == HIST_BOOK && sum.verses && n++ < cap) out[n - 1] = sum;
+        }
+    }
+    for (size_t t = 0; t < nt; t++) re_free(w[t].re);
+    query_free(job.bq);
+    return n;
+}
@@ -1,194 +1,766 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
-#include <cctype>
-#include <vector>
 #include <string>
+#include <vector>
+#include <dirent.h>
+#include <unistd.h>
+#include "corpus.h"
 
-// Minimized C++ Implementation
+// Minimized C++ Implementation: a small client of the corpus library
 
-#define MAX_LINE 4096
+#define DATA_DIR ".."
 #define COLOR_RED "\x1b[31m"
 #define COLOR_RESET "\x1b[0m"
+#define HILITE_ON "\x1b[7m"
+#define HILITE_OFF "\x1b[27m"
+#define SEARCH_BATCH 4096
+#define MAX_TEXT 8192
+#define CACHE_MAX_BYTES (16 * 1024 * 1024)
 
-static char* normalize(const char* str) {
-    static char buf[MAX_LINE * 2];
-    char* out = buf;
-    while (*str) {
-        unsigned char c1 = (unsigned char)str[0];
-        if (c1 > 127 && str[1]) {
-            unsigned char c2 = (unsigned char)str[1];
-            // Romanian Diacritics
-            if (c1 == 0xC4 && c2 == 0x83) { *out++ = 'a'; str += 2; continue; } // ă
-            if (c1 == 0xC3 && c2 == 0xA2) { *out++ = 'a'; str += 2; continue; } // â
-            if (c1 == 0xC3 && c2 == 0xAE) { *out++ = 'i'; str += 2; continue; } // î
-            if (c1 == 0xC8 && c2 == 0x99) { *out++ = 's'; str += 2; continue; } // ș
-            if (c1 == 0xC5 && c2 == 0x9F) { *out++ = 's'; str += 2; continue; } // ş
-            if (c1 == 0xC8 && c2 == 0x9B) { *out++ = 't'; str += 2; continue; } // ț
-            if (c1 == 0xC5 && c2 == 0xA3) { *out++ = 't'; str += 2; continue; } // ţ
-            if (c1 == 0xC4 && c2 == 0x82) { *out++ = 'a'; str += 2; continue; } // Ă
-        }
-        *out++ = tolower((unsigned char)*str++);
-    }
-    *out = 0;
-    return buf;
-}
-
-static void print_formatted(const char* text) {
+// Matches (if any) in reverse video. That is independent of the red of the
+// words of Jesus, so a match nests inside a red span or crosses its edge.
+static void print_formatted(const char* text, const MatchSpan* m = NULL, size_t nm = 0) {
     const char* p = text;
+    size_t k = 0;
+    bool on = false;
     while (*p) {
+        size_t off = p - text;
+        if (on && off >= m[k].end) { printf(HILITE_OFF); on = false; k++; }
+        while (!on && k < nm && off >= m[k].end) k++;
+        if (!on && k < nm && off >= m[k].start) { printf(HILITE_ON); on = true; }
         if (strncmp(p, "<span class=\\'Isus\\'>", 21) == 0) {
             printf("%s", COLOR_RED); p += 21;
         } else if (strncmp(p, "<span class='Isus'>", 19) == 0) {
             printf("%s", COLOR_RED); p += 19;
         } else if (strncmp(p, "</span>", 7) == 0) {
             printf("%s", COLOR_RESET); p += 7;
+            if (on) printf(HILITE_ON); // the reset ended it too
         } else {
             putchar(*p); p++;
         }
     }
+    if (on) printf(HILITE_OFF);
+}
+
+// Prints one verse in CLI format; other translations get their code in front
+// and no section title, book (if given) goes into the reference
+static void print_text(const Verse* v, const char* label, const char* book, const MatchSpan* m = NULL, size_t nm = 0) {
+    if (label) printf("%s ", label);
+    else if (v->title[0]) printf("\n### %s ###\n", v->title);
+    if (book) printf("[%s %d:%d] ", book, v->ref.chapter(), v->ref.verse());
+    else printf("[%d:%d] ", v->ref.chapter(), v->ref.verse());
+    print_formatted(v->text, m, nm);
+    if (v->refs[0]) { // "Refs;Refs", replace ; with ,
+        printf(" (");
+        for (const char* rp = v->refs; *rp; rp++) {
+            if (*rp == ';') printf(", ");
+            else putchar(*rp);
+        }
+        printf(")");
+    }
+    printf("\n");
+}
+
+// --format=ndjson|tsv: one record per verse for pipelines, written through
+// one static buffer (no allocation per record). Text comes without markup,
+// spans are [start, end) byte offsets of the words of Jesus in it.
+enum { FMT_TEXT, FMT_NDJSON, FMT_TSV };
+static int format = FMT_TEXT;
+
+#define OUT_BUF (64 * 1024)
+#define MAX_SPANS 256
+static char out_buf[OUT_BUF];
+static size_t out_len;
+
+static void out_flush() {
+    fwrite(out_buf, 1, out_len, stdout);
+    out_len = 0;
+}
+
+static void out_put(const char* s, size_t n) {
+    if (n > OUT_BUF - out_len) {
+        out_flush();
+        if (n > OUT_BUF) { fwrite(s, 1, n, stdout); return; }
+    }
+    memcpy(out_buf + out_len, s, n);
+    out_len += n;
+}
+
+static void out_str(const char* s) { out_put(s, strlen(s)); }
+
+static void out_num(unsigned v) {
+    char b[16];
+    out_put(b, snprintf(b, sizeof(b), "%u", v));
+}
+
+// Escape letter per byte (0: copied as is); 'u' means \u00XX
+static char json_esc[256], tsv_esc[256];
+
+static void init_escapes() {
+    for (int c = 0; c < 0x20; c++) json_esc[c] = 'u';
+    json_esc['"'] = '"'; json_esc['\\'] = '\\';
+    json_esc['\n'] = 'n'; json_esc['\r'] = 'r'; json_esc['\t'] = 't';
+    tsv_esc['\\'] = '\\'; tsv_esc['\n'] = 'n'; tsv_esc['\r'] = 'r'; tsv_esc['\t'] = 't';
+}
+
+// Copies runs of plain bytes in one go and escapes only the bytes between them
+static void out_escaped(const char* s, size_t n, const char* esc) {
+    const char* end = s + n;
+    while (s < end) {
+        const char* run = s;
+        while (s < end && !esc[(unsigned char)*s]) s++;
+        out_put(run, s - run);
+        if (s == end) break;
+        char e[8] = { '\\', esc[(unsigned char)*s] };
+        out_put(e, e[1] == 'u' ? snprintf(e, sizeof(e), "\\u%04x", (unsigned char)*s) : 2);
+        s++;
+    }
+}
+
+static void out_json(const char* s, size_t n) {
+    out_put("\"", 1);
+    out_escaped(s, n, json_esc);
+    out_put("\"", 1);
+}
+
+// Verse text without markup into text, Jesus spans into spans; returns the length
+static size_t strip_markup(const char* p, char* text, size_t cap, uint32_t* spans, int* nspans) {
+    size_t len = 0;
+    *nspans = 0;
+    while (*p && len < cap) {
+        if (*p != '<') { text[len++] = *p++; continue; }
+        bool open = strncmp(p, "<span class='Isus'>", 19) == 0 || strncmp(p, "<span class=\\'Isus\\'>", 21) == 0;
+        if (open && *nspans < MAX_SPANS) {
+            spans[2 * *nspans] = spans[2 * *nspans + 1] = len;
+            (*nspans)++;
+        } else if (strncmp(p, "</span>", 7) == 0 && *nspans) spans[2 * *nspans - 1] = len;
+        while (*p && *p != '>') p++;
+        if (*p) p++;
+    }
+    return len;
+}
+
+// Offset in the text without markup of offset off in the verse text
+static size_t stripped_offset(const char* text, size_t off) {
+    size_t n = 0;
+    for (const char* p = text; *p && (size_t)(p - text) < off;) {
+        if (*p != '<') { n++; p++; continue; }
+        while (*p && *p != '>') p++;
+        if (*p) p++;
+    }
+    return n;
+}
+
+static void print_record(Corpus* corpus, const Verse* v, const char* label, bool context = false,
+                         const MatchSpan* m = NULL, size_t nm = 0) {
+    static char text[MAX_TEXT];
+    uint32_t spans[2 * MAX_SPANS];
+    int nspans;
+    size_t len = strip_markup(v->text, text, sizeof(text), spans, &nspans);
+    const char* book = corpus->book_name(v->ref.book());
+    if (format == FMT_NDJSON) {
+        out_put("{", 1);
+        if (label) { out_str("\"translation\":"); out_json(label, strlen(label)); out_put(",", 1); }
+        out_str("\"book\":"); out_json(book, strlen(book));
+        out_str(",\"chapter\":"); out_num(v->ref.chapter());
+        out_str(",\"verse\":"); out_num(v->ref.verse());
+        out_str(",\"title\":"); out_json(v->title, strlen(v->title));
+        out_str(",\"text\":"); out_json(text, len);
+        out_str(",\"spans\":[");
+        for (int i = 0; i < nspans; i++) {
+            out_str(i ? ",[" : "["); out_num(spans[2 * i]); out_put(",", 1); out_num(spans[2 * i + 1]); out_put("]", 1);
+        }
+        out_str("],\"refs\":[");
+        for (const char* r = v->refs; *r;) {
+            const char* e = strchr(r, ';');
+            if (!e) e = r + strlen(r);
+            if (r != v->refs) out_put(",", 1);
+            out_json(r, e - r);
+            r = *e ? e + 1 : e;
+        }
+        out_put("]", 1);
+        if (m) {
+            // --highlight: matches like spans, in the text without markup
+            out_str(",\"matches\":[");
+            for (size_t i = 0; i < nm; i++) {
+                out_str(i ? ",[" : "[");
+                out_num(stripped_offset(v->text, m[i].start)); out_put(",", 1);
+                out_num(stripped_offset(v->text, m[i].end)); out_put("]", 1);
+            }
+            out_put("]", 1);
+        }
+        out_str(context ? ",\"context\":true}\n" : "}\n");
+    } else {
+        if (label) { out_escaped(label, strlen(label), tsv_esc); out_put("\t", 1); }
+        out_escaped(book, strlen(book), tsv_esc); out_put("\t", 1);
+        out_num(v->ref.chapter()); out_put("\t", 1);
+        out_num(v->ref.verse()); out_put("\t", 1);
+        out_escaped(v->title, strlen(v->title), tsv_esc); out_put("\t", 1);
+        out_escaped(text, len, tsv_esc); out_put("\t", 1);
+        for (int i = 0; i < nspans; i++) {
+            if (i) out_put(",", 1);
+            out_num(spans[2 * i]); out_put("-", 1); out_num(spans[2 * i + 1]);
+        }
+        out_put("\t", 1);
+        out_escaped(v->refs, strlen(v->refs), tsv_esc); // already ; separated
+        out_put("\n", 1);
+    }
+}
+
+static void print_verse(Corpus* corpus, const Verse* v, const char* label = NULL, bool with_book = false,
+                        const MatchSpan* m = NULL, size_t nm = 0) {
+    if (format != FMT_TEXT) print_record(corpus, v, label, false, m, nm);
+    else print_text(v, label, with_book ? corpus->book_name(v->ref.book()) : NULL, m, nm);
+}
+
+// Other translations: one directory each under translations/, holding the
+// usual data files (built with `extractor -verses ... -canon map.txt` when
+// the versification differs). Passages and hits line up by canonical ID.
+#define TRANSLATIONS_DIR "translations"
+#define PRIMARY_CODE "cornilescu"
+#define MAX_TRANSLATIONS 32
+
+struct Translation {
+    char code[64];
+    Corpus* corpus;
+};
+
+static bool wanted(const char* only, const char* code) {
+    if (!only || !*only) return true;
+    size_t n = strlen(code);
+    for (const char* p = only; (p = strstr(p, code)); p += n)
+        if ((p == only || p[-1] == ',') && (p[n] == 0 || p[n] == ',')) return true;
+    return false;
+}
+
+static int by_code(const void* a, const void* b) { return strcmp(((const Translation*)a)->code, ((const Translation*)b)->code); }
+
+// Where the data was found (see data_dir)
+static std::string data_root = DATA_DIR;
+
+// Opens the translations named in only (comma separated; all when empty)
+static int open_translations(const char* only, Translation* out) {
+    std::string root = data_root + "/" TRANSLATIONS_DIR;
+    DIR* d = opendir(root.c_str());
+    if (!d) return 0;
+    int n = 0;
+    for (struct dirent* e; n < MAX_TRANSLATIONS && (e = readdir(d));) {
+        if (e->d_name[0] == '.' || !wanted(only, e->d_name)) continue;
+        char dir[MAX_TEXT];
+        snprintf(dir, sizeof(dir), "%s/%s", root.c_str(), e->d_name);
+        Corpus* c = new Corpus;
+        if (!c->open(dir)) { delete c; continue; }
+        snprintf(out[n].code, sizeof(out[n].code), "%s", e->d_name);
+        out[n++].corpus = c;
+    }
+    closedir(d);
+    qsort(out, n, sizeof(Translation), by_code);
+    return n;
+}
+
+static void close_translations(Translation* t, int n) {
+    for (int i = 0; i < n; i++) delete t[i].corpus;
+}
+
+// read --parallel: every verse of the passage, then the same canonical verse
+// from each translation by direct index
+static void read_parallel(Corpus* corpus, uint32_t first, uint32_t count, Translation* t, int nt) {
+    for (uint32_t i = first; i < first + count; i++) {
+        const Verse* v = corpus->verse(i);
+        if (!v) break; // bible_data.toc older than the text
+        print_verse(corpus, v, nt && format != FMT_TEXT ? PRIMARY_CODE : NULL);
+        uint32_t id = corpus->canonical(i), j;
+        for (int k = 0; k < nt; k++) {
+            if (t[k].corpus->find_canonical(id, &j)) print_verse(t[k].corpus, t[k].corpus->verse(j), t[k].code);
+            else if (format == FMT_TEXT) printf("%s -\n", t[k].code);
+        }
+    }
+}
+
+// Keyword in context: the text (without markup) around [at, end) of the
+// verse text, width bytes each side, the match in reverse video when mark
+#define KWIC_CONTEXT 40
+
+static void print_kwic(Corpus* corpus, const Verse* v, size_t at, size_t end, int width, bool mark) {
+    char line[MAX_TEXT];
+    size_t len = 0, s = 0, e = 0;
+    const char* p = v->text;
+    while (*p && len < sizeof(line) - 1) {
+        size_t off = p - v->text;
+        if (off <= at) s = len;
+        if (off <= end) e = len;
+        if (*p == '<') {
+            while (*p && *p != '>') p++;
+            if (*p) p++;
+        } else {
+            line[len++] = *p++;
+        }
+    }
+    if ((size_t)(p - v->text) <= at) s = len;
+    if ((size_t)(p - v->text) <= end) e = len;
+    size_t lo = s > (size_t)width ? s - width : 0, hi = e + width < len ? e + width : len;
+    while (lo > 0 && ((unsigned char)line[lo] & 0xC0) == 0x80) lo--;
+    while (hi < len && ((unsigned char)line[hi] & 0xC0) == 0x80) hi++;
+    printf("%s %d:%d\t%s%.*s", corpus->book_name(v->ref.book()), v->ref.chapter(), v->ref.verse(),
+           lo ? "..." : "", (int)(s - lo), line + lo);
+    if (mark) printf(HILITE_ON "%.*s" HILITE_OFF, (int)(e - s), line + s);
+    else printf("%.*s", (int)(e - s), line + s);
+    printf("%.*s%s\n", (int)(hi - e), line + e, hi < len ? "..." : "");
+}
+
+// Search paging: --limit N, --offset N, --after <cursor> (from a previous
+// page), --count (only count matches). Default keeps the old cap of 51 hits.
+// --context N prints N verses of the same book around every hit,
+// --highlight marks the matches, --kwic[=W] prints one snippet per match.
+struct Paging {
+    int limit, offset;
+    uint32_t from;      // first verse index to look at, --after X gives X + 1
+    bool count_only;
+    int context;
+    bool highlight;
+    int kwic;
+    bool stats;
+};
+
+#define MAX_MATCHES 256
+
+// One hit, with its matches when they are asked for
+static void print_hit(Corpus* corpus, uint32_t index, const char* query, int flags, const Paging* pg) {
+    const Verse* v = corpus->verse(index);
+    if (!pg->highlight && !pg->kwic) { print_verse(corpus, v); return; }
+    MatchSpan m[MAX_MATCHES];
+    size_t n = corpus->matches(index, query, flags, m, MAX_MATCHES);
+    if (n > MAX_MATCHES) n = MAX_MATCHES;
+    if (!pg->kwic || format != FMT_TEXT) { print_verse(corpus, v, NULL, false, m, n); return; }
+    // A hit by filters alone has no match to center on
+    if (!n) print_kwic(corpus, v, 0, 0, pg->kwic, false);
+    for (size_t i = 0; i < n; i++) print_kwic(corpus, v, m[i].start, m[i].end, pg->kwic, pg->highlight);
+}
+
+// Context windows: hits come in corpus order, so overlapping windows merge by
+// remembering how far printing got. The verses around a hit were parsed on
+// the way to it (or are one index lookup away), nothing is decoded twice.
+struct Context {
+    Corpus* corpus;
+    const char* query;
+    int flags;
+    const Paging* pg;
+    int n;
+    int book;           // of the last hit
+    uint32_t next;      // first verse not printed yet
+    uint32_t tail;      // trailing context of the last hit ends here
+    bool any;
+};
+
+static void context_verse(Context* cx, const Verse* v) {
+    if (format == FMT_TEXT) print_text(v, NULL, NULL);
+    else print_record(cx->corpus, v, NULL, true);
+}
+
+// Trailing context of the last hit, up to (not including) upto
+static void context_flush(Context* cx, uint32_t upto) {
+    for (; cx->next < cx->tail && cx->next < upto; cx->next++) {
+        const Verse* v = cx->corpus->verse(cx->next);
+        if (!v || v->ref.book() != cx->book) { cx->tail = cx->next; break; }
+        context_verse(cx, v);
+    }
+}
+
+static void context_hit(Context* cx, uint32_t h) {
+    const Verse* hit = cx->corpus->verse(h);
+    context_flush(cx, h);
+    uint32_t lo = h > (uint32_t)cx->n ? h - cx->n : 0;
+    if (cx->any && lo < cx->next) lo = cx->next;
+    while (lo < h && cx->corpus->verse(lo)->ref.book() != hit->ref.book()) lo++;
+    // Windows that do not touch are separated like grep -C does
+    if (cx->any && (lo > cx->next || hit->ref.book() != cx->book) && format == FMT_TEXT) printf("--\n");
+    for (uint32_t i = lo; i < h; i++) context_verse(cx, cx->corpus->verse(i));
+    print_hit(cx->corpus, h, cx->query, cx->flags, cx->pg);
+    cx->book = hit->ref.book();
+    cx->next = h + 1;
+    cx->tail = h + 1 + cx->n;
+    cx->any = true;
+}
+
+// --stats: what the chapter filters saved, over every call of one search
+static void add_stats(SearchStats* sum, const SearchStats* s) {
+    sum->chapters += s->chapters;
+    sum->skipped += s->skipped;
+}
+
+static void print_stats(const Paging* pg, const SearchStats* s) {
+    if (pg->stats) fprintf(stderr, "bloom: %u of %u chapters skipped\n", s->skipped, s->chapters);
+}
+
+static void search(Corpus* corpus, const char* query, int flags, const Paging* pg) {
+    if (pg->count_only) {
+        uint32_t n = corpus->count(query, flags, pg->from);
+        if (corpus->error()) { fprintf(stderr, "Error: %s\n", corpus->error()); return; }
+        printf("%u\n", n);
+        print_stats(pg, corpus->stats());
+        return;
+    }
+    // One call usually covers the page plus the hit that makes the cursor
+    size_t want = (size_t)pg->offset + pg->limit + 1;
+    size_t cap = want < SEARCH_BATCH ? want : SEARCH_BATCH;
+    uint32_t* ids = (uint32_t*)malloc(cap * sizeof(uint32_t));
+    size_t seen = 0;
+    uint32_t from = pg->from, last = pg->from - 1;
+    Context cx = { corpus, query, flags, pg, pg->context, 0, 0, 0, false };
+    SearchStats stats = SearchStats();
+    for (;;) {
+        size_t n = corpus->search(query, flags, from, ids, cap);
+        if (corpus->error()) fprintf(stderr, "Error: %s\n", corpus->error());
+        add_stats(&stats, corpus->stats());
+        for (size_t i = 0; i < n; i++, seen++) {
+            if (seen == want - 1) {
+                // One hit past the page: hand out the last hit before it as
+                // the cursor (--after is exclusive) and stop
+                context_flush(&cx, ids[i]);
+                if (seen || pg->from) fprintf(stderr, "next: --after %u\n", last);
+                print_stats(pg, &stats);
+                free(ids);
+                return;
+            }
+            last = ids[i];
+            if (seen < (size_t)pg->offset) continue;
+            if (pg->context) context_hit(&cx, ids[i]);
+            else print_hit(corpus, ids[i], query, flags, pg);
+        }
+        if (n < cap) break;
+        from = ids[n - 1] + 1;
+    }
+    context_flush(&cx, UINT32_MAX);
+    print_stats(pg, &stats);
+    free(ids);
+}
+
+// Section titles (toc, search --titles) come from the corpus structure alone,
+// the verses they start at are not decoded
+static void print_title(Corpus* corpus, const SectionTitle* s, bool with_book) {
+    const char* book = corpus->book_name(s->ref.book());
+    if (format == FMT_TEXT) {
+        if (with_book) printf("[%s %d:%d] %s\n", book, s->ref.chapter(), s->ref.verse(), s->title);
+        else printf("  [%d:%d] %s\n", s->ref.chapter(), s->ref.verse(), s->title);
+    } else if (format == FMT_NDJSON) {
+        out_str("{\"book\":"); out_json(book, strlen(book));
+        out_str(",\"chapter\":"); out_num(s->ref.chapter());
+        out_str(",\"verse\":"); out_num(s->ref.verse());
+        out_str(",\"title\":"); out_json(s->title, strlen(s->title));
+        out_str("}\n");
+    } else {
+        out_escaped(book, strlen(book), tsv_esc); out_put("\t", 1);
+        out_num(s->ref.chapter()); out_put("\t", 1);
+        out_num(s->ref.verse()); out_put("\t", 1);
+        out_escaped(s->title, strlen(s->title), tsv_esc); out_put("\n", 1);
+    }
+}
+
+// search --titles: the query runs over the section titles instead
+static void search_titles(Corpus* corpus, const char* query, int flags, const Paging* pg) {
+    size_t n = corpus->find_titles(query, flags, NULL, 0);
+    if (corpus->error()) { fprintf(stderr, "Error: %s\n", corpus->error()); return; }
+    if (pg->count_only) { printf("%zu\n", n); return; }
+    SectionTitle* t = (SectionTitle*)malloc((n ? n : 1) * sizeof(SectionTitle));
+    corpus->find_titles(query, flags, t, n);
+    if (format == FMT_TSV) out_str("book\tchapter\tverse\ttitle\n");
+    for (size_t i = pg->offset; i < n && i < (size_t)pg->offset + pg->limit; i++) print_title(corpus, &t[i], true);
+    free(t);
+}
+
+// toc <Book> [chapter]: verses per chapter and the section titles in them;
+// other formats get one record per title
+static void toc(Corpus* corpus, int book, int chapter) {
+    int nch = corpus->chapter_count(book);
+    if (chapter < 0 || chapter > nch) return;
+    size_t n = corpus->titles(book, chapter, NULL, 0);
+    SectionTitle* t = (SectionTitle*)malloc((n ? n : 1) * sizeof(SectionTitle));
+    corpus->titles(book, chapter, t, n);
+    if (format == FMT_TSV) out_str("book\tchapter\tverse\ttitle\n");
+    if (format == FMT_TEXT) printf("### %s ###\n", corpus->book_name(book));
+    size_t k = 0;
+    for (int ch = chapter ? chapter : 1; ch <= (chapter ? chapter : nch); ch++) {
+        uint32_t first, count;
+        if (format == FMT_TEXT && corpus->lookup(book, ch, 0, &first, &count)) printf("%d (%u verses)\n", ch, count);
+        for (; k < n && t[k].ref.chapter() == ch; k++) print_title(corpus, &t[k], false);
+    }
+    free(t);
+}
+
+// search --histogram[=book|chapter]: matches per book or chapter, counted
+// over the whole text with no cap; no verse is printed
+static void histogram(Corpus* corpus, const char* query, int flags, int by) {
+    size_t cap = 0;
+    for (int b = 1; b <= corpus->book_count(); b++) cap += by == HIST_CHAPTER ? corpus->chapter_count(b) : 1;
+    HitCount* h = (HitCount*)malloc((cap ? cap : 1) * sizeof(HitCount));
+    size_t n = corpus->histogram(query, flags, by, h, cap);
+    if (corpus->error()) fprintf(stderr, "Error: %s\n", corpus->error());
+    if (n > cap) n = cap;
+    if (format == FMT_TSV) out_str(by == HIST_CHAPTER ? "book\tchapter\tverses\thits\n" : "book\tverses\thits\n");
+    if (format == FMT_TEXT) printf("   hits  verses\n");
+    uint32_t verses = 0, hits = 0;
+    for (size_t i = 0; i < n; i++) {
+        const char* book = corpus->book_name(h[i].ref.book());
+        verses += h[i].verses;
+        hits += h[i].hits;
+        if (format == FMT_TEXT) {
+            if (by == HIST_CHAPTER) printf("%7u %7u  %s %d\n", h[i].hits, h[i].verses, book, h[i].ref.chapter());
+            else printf("%7u %7u  %s\n", h[i].hits, h[i].verses, book);
+        } else if (format == FMT_NDJSON) {
+            out_str("{\"book\":"); out_json(book, strlen(book));
+            if (by == HIST_CHAPTER) { out_str(",\"chapter\":"); out_num(h[i].ref.chapter()); }
+            out_str(",\"verses\":"); out_num(h[i].verses);
+            out_str(",\"hits\":"); out_num(h[i].hits);
+            out_str("}\n");
+        } else {
+            out_escaped(book, strlen(book), tsv_esc); out_put("\t", 1);
+            if (by == HIST_CHAPTER) { out_num(h[i].ref.chapter()); out_put("\t", 1); }
+            out_num(h[i].verses); out_put("\t", 1);
+            out_num(h[i].hits); out_put("\n", 1);
+        }
+    }
+    if (format == FMT_TEXT) printf("%7u %7u  total\n", hits, verses);
+    free(h);
+}
+
+// search --parallel: the query runs over every text, hits are merged in
+// canonical order (then primary first); --limit / --offset count hits
+struct ParallelHit {
+    uint32_t id;
+    int text;     // 0 primary, k + 1 translation k
+    uint32_t index;
+};
+
+static int by_canonical(const void* a, const void* b) {
+    const ParallelHit* x = (const ParallelHit*)a;
+    const ParallelHit* y = (const ParallelHit*)b;
+    if (x->id != y->id) return x->id < y->id ? -1 : 1;
+    if (x->text != y->text) return x->text - y->text;
+    return x->index < y->index ? -1 : x->index > y->index;
+}
+
+static void search_parallel(Corpus* corpus, const char* query, int flags, const Paging* pg, Translation* t, int nt) {
+    std::vector<ParallelHit> hits;
+    std::vector<uint32_t> ids(SEARCH_BATCH);
+    for (int k = 0; k <= nt; k++) {
+        // One pass per text: each batch picks up where the last one stopped
+        Corpus* c = k ? t[k - 1].corpus : corpus;
+        for (uint32_t from = 0;;) {
+            size_t n = c->search(query, flags, from, ids.data(), ids.size());
+            if (c->error()) { fprintf(stderr, "Error: %s\n", c->error()); return; }
+            for (size_t i = 0; i < n; i++) {
+                ParallelHit h = { c->canonical(ids[i]), k, ids[i] };
+                hits.push_back(h);
+            }
+            if (n < ids.size()) break;
+            from = ids[n - 1] + 1;
+        }
+    }
+    if (pg->count_only) { printf("%zu\n", hits.size()); return; }
+    qsort(hits.data(), hits.size(), sizeof(ParallelHit), by_canonical);
+    for (size_t i = pg->offset; i < hits.size() && i < (size_t)pg->offset + pg->limit; i++) {
+        Corpus* c = hits[i].text ? t[hits[i].text - 1].corpus : corpus;
+        print_verse(c, c->verse(hits[i].index), hits[i].text ? t[hits[i].text - 1].code : PRIMARY_CODE, true);
+    }
+}
+
+// freq [N] [--by=book|testament]: top N words of the folded text
+static void freq(Corpus* corpus, int top, int by) {
+    int groups = by == FREQ_BOOK ? corpus->book_count() : by == FREQ_TESTAMENT ? 2 : 1;
+    size_t cap = (size_t)top * groups;
+    WordFreq* out = (WordFreq*)malloc((cap ? cap : 1) * sizeof(WordFreq));
+    size_t n = corpus->freq(by, top, out, cap);
+    for (size_t i = 0; i < n; i++) {
+        if (by != FREQ_ALL && (i == 0 || out[i].group != out[i - 1].group)) {
+            const char* name = by == FREQ_BOOK ? corpus->book_name(out[i].group)
+                             : out[i].group == 1 ? "Vechiul Testament" : "Noul Testament";
+            printf("%s### %s ###\n", i ? "\n" : "", name);
+        }
+        printf("%7u %.*s\n", out[i].count, (int)out[i].len, out[i].word);
+    }
+    free(out);
+}
+
+// concordance <word>: every occurrence with its reference and some context
+static void concordance(Corpus* corpus, const char* word) {
+    size_t n = corpus->concordance(word, 0, NULL, 0);
+    if (corpus->error()) { fprintf(stderr, "Error: %s\n", corpus->error()); return; }
+    WordHit* hits = (WordHit*)malloc((n ? n : 1) * sizeof(WordHit));
+    corpus->concordance(word, 0, hits, n);
+    for (size_t i = 0; i < n; i++) {
+        size_t at = corpus->original_offset(hits[i].index, hits[i].offset);
+        print_kwic(corpus, corpus->verse(hits[i].index), at, at, KWIC_CONTEXT, false);
+    }
+    free(hits);
+}
+
+// The data sits one level above the binary (bible_reader_cpp/..), so it is
+// found from any working directory; without /proc, relative to the working
+// directory as before
+static std::string data_dir() {
+    char exe[MAX_TEXT];
+    ssize_t n = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+    if (n <= 0) return DATA_DIR;
+    exe[n] = 0;
+    char* slash = strrchr(exe, '/');
+    if (!slash) return DATA_DIR;
+    *slash = 0;
+    return std::string(exe) + "/" DATA_DIR;
+}
+
+// Option a is exactly name, alone or as name=value
+static bool is_opt(const char* a, const char* name) {
+    size_t n = strlen(name);
+    return strncmp(a, name, n) == 0 && (a[n] == 0 || a[n] == '=');
 }
 
 int main(int argc, char** argv) {
     if (argc < 2) {
-        printf("Usage: %s <list|read|search> [args...]\n", argv[0]);
+        printf("Usage: %s <list|read|toc|search|freq|concordance> [args...]\n", argv[0]);
         return 1;
     }
 
-    const char* command = argv[1];
-    
-    // Hardcode parent dir for this environment context
-    FILE* fp = popen("xz -d -c ../bible_data.txt.xz", "r");
-    if (!fp) {
-        perror("popen");
+    // --format=ndjson|tsv may come anywhere; take it out of the arguments
+    // and so may --parallel[=code,code] (read / search across translations)
+    const char* parallel = NULL;
+    bool titles = false; // search --titles prints its own TSV header
+    bool counts = false; // ... and so does search --histogram
+    int kept = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--titles") == 0) titles = true;
+        if (is_opt(argv[i], "--histogram")) counts = true;
+        if (strcmp(argv[i], "--parallel") == 0) { parallel = ""; continue; }
+        if (strncmp(argv[i], "--parallel=", 11) == 0) { parallel = argv[i] + 11; continue; }
+        if (strncmp(argv[i], "--format=", 9) != 0) { argv[kept++] = argv[i]; continue; }
+        const char* f = argv[i] + 9;
+        if (strcmp(f, "ndjson") == 0) format = FMT_NDJSON;
+        else if (strcmp(f, "tsv") == 0) format = FMT_TSV;
+        else if (strcmp(f, "text") == 0) format = FMT_TEXT;
+        else { fprintf(stderr, "Unknown format: %s\n", f); return 1; }
+    }
+    argc = kept;
+    init_escapes();
+    if (argc < 2) {
+        printf("Usage: %s <list|read|toc|search|freq|concordance> [args...]\n", argv[0]);
         return 1;
     }
 
-    char line[MAX_LINE];
-    char current_book[100] = "";
-    int current_chapter = 0;
-    char current_title[MAX_LINE] = "";
-    char last_refs[MAX_LINE] = "";
-
-    // Search Prep
-    char query_norm[MAX_LINE] = "";
-    if (strcmp(command, "search") == 0 && argc >= 3) {
-         // Join args
-         std::string q;
-         for(int i=2; i<argc; i++) {
-             q += argv[i];
-             if(i < argc-1) q += " ";
-         }
-         strcpy(query_norm, normalize(q.c_str()));
-    }
-
-    int search_count = 0;
-    
-    // Read args
-    const char* target_book = (argc > 2) ? argv[2] : "";
-    int target_chapter = (argc > 3) ? atoi(argv[3]) : 0;
-    int target_verse_num = (argc > 4) ? atoi(argv[4]) : 0;
-
-    // Line loop
-    while (fgets(line, sizeof(line), fp)) {
-        size_t len = strlen(line);
-        if (len > 0 && line[len-1] == '\n') line[len-1] = 0;
-
-        if (line[0] == '#') {
-            strcpy(current_book, line + 2);
-            current_chapter = 0;
-            current_title[0] = 0;
-            continue;
-        }
-
-        if (line[0] == '=') {
-            current_chapter = atoi(line + 2);
-            current_title[0] = 0;
-            continue;
-        }
-
-        if (line[0] == 'T') {
-            strcpy(current_title, line + 2);
-            continue;
-        }
-        
-        // Verses start with Digit
-        if (isdigit(line[0])) {
-            char* verse_end = strchr(line, ' ');
-            if (!verse_end) continue;
-            
-            *verse_end = 0;
-            int v_num = atoi(line);
-            char* text = verse_end + 1;
-
-            bool match = false;
-            
-            if (strcmp(command, "read") == 0) {
-                 if (strcasecmp(current_book, target_book) == 0 && current_chapter == target_chapter) {
-                     if (target_verse_num == 0 || target_verse_num == v_num) {
-                         match = true;
-                     }
-                 }
-            } else if (strcmp(command, "search") == 0) {
-                 // Optimization: only normalize if needed?
-                 // Simple strstr on normalized
-                 // Note: normalize returns pointer to static buf, call twice is bad. copy first.
-                 char text_norm[MAX_LINE * 2];
-                 strcpy(text_norm, normalize(text));
-                 if (strstr(text_norm, query_norm)) match = true;
-            }
+    const char* command = argv[1];
 
-            if (match) {
-                 // Check next character in stream for References
-                 // PEEK logic from C version
-                 int c = fgetc(fp);
-                 if (c == 'R') {
-                     // Read Refs
-                     fgets(last_refs, sizeof(last_refs), fp);
-                     last_refs[strcspn(last_refs, "\n")] = 0;
-                 } else if (c != EOF) {
-                     ungetc(c, fp);
-                     last_refs[0] = 0;
-                 } else {
-                     last_refs[0] = 0;
-                 }
-
-                 if (current_title[0]) {
-                     printf("\n### %s ###\n", current_title);
-                     current_title[0] = 0;
-                 }
-
-                 printf("[%d:%d] ", current_chapter, v_num);
-                 print_formatted(text);
-                 
-                 if (last_refs[1]) { // R Refs...
-                     printf(" (");
-                     char* r = last_refs + 2; // Skip " Renspace"
-                     // Wait, line was "R Refs...". fgets read " Refs...".
-                     // Actually c='R'. fgets reads " Refs...". so last_refs is " Refs..."
-                     // last_refs[0] is space.
-                     // C version code: `printf(" (%s)", ref_Line + 1);`
-                     // New format: Replace ; with ,
-                     char* rp = last_refs + 1; // skip space
-                     while(*rp) {
-                         if (*rp == ';') printf(", ");
-                         else putchar(*rp);
-                         rp++;
-                     }
-                     printf(")");
-                 }
-                 printf("\n");
-                 
-                 if (strcmp(command, "search") == 0) {
-                     search_count++;
-                     if (search_count > 50) return 0;
-                 }
-            }
-            // Clear title after verse processed or skipped
-            current_title[0] = 0;
+    Corpus corpus;
+    data_root = data_dir();
+    if (!corpus.open(data_root.c_str())) {
+        data_root = DATA_DIR;
+        if (!corpus.open(DATA_DIR)) {
+            fprintf(stderr, "Error: could not open %s/bible_data.txt.xz\n", DATA_DIR);
+            return 1;
         }
     }
 
-    pclose(fp);
+    Translation tr[MAX_TRANSLATIONS];
+    int ntr = parallel ? open_translations(parallel, tr) : 0;
+    if (parallel && !ntr) fprintf(stderr, "Warning: no translations in %s/%s\n", data_root.c_str(), TRANSLATIONS_DIR);
+
+    if (format == FMT_TSV && (strcmp(command, "read") == 0 || (strcmp(command, "search") == 0 && !titles && !counts)))
+        out_str(ntr ? "translation\tbook\tchapter\tverse\ttitle\ttext\tspans\trefs\n" : "book\tchapter\tverse\ttitle\ttext\tspans\trefs\n");
+
+    if (strcmp(command, "list") == 0) {
+        for (int b = 1; b <= corpus.book_count(); b++) printf("- %s\n", corpus.book_name(b));
+    } else if (strcmp(command, "read") == 0) {
+        int book = argc > 2 ? corpus.find_book(argv[2]) : 0;
+        int chapter = argc > 3 ? atoi(argv[3]) : 0;
+        int verse = argc > 4 ? atoi(argv[4]) : 0;
+        uint32_t first, count;
+        if (book && corpus.lookup(book, chapter, verse, &first, &count)) {
+            read_parallel(&corpus, first, count, tr, ntr);
+        }
+    } else if (strcmp(command, "toc") == 0) {
+        int book = argc > 2 ? corpus.find_book(argv[2]) : 0;
+        if (book) toc(&corpus, book, argc > 3 ? atoi(argv[3]) : 0);
+    } else if (strcmp(command, "search") == 0) {
+        // --word matches whole words only, using bible_data.tok when present;
+        // --regex takes a pattern matched against the folded text, anything
+        // else may use AND / OR / NOT and in: / ot: / nt: filters
+        // --cache[=dir] keeps whole result lists on disk (BIBLE_CACHE_DIR also
+        // turns it on) so repeated searches skip the decode and scan
+        // --titles searches the section titles instead of the verses
+        // --stem matches every form of each word (lumina: luminii, luminează),
+        // from the posting lists of bible_data.stm when present
+        // --histogram[=book|chapter] counts every match per book / chapter
+        // --stats tells how many chapters bible_data.blm let the scan skip
+        Paging pg = { 51, 0, 0, false, 0, false, 0, false };
+        int flags = SEARCH_QUERY, hist = -1;
+        std::string q;
+        const char* cache = getenv("BIBLE_CACHE_DIR");
+        for (int i = 2; i < argc; i++) {
+            const char* a = argv[i];
+            if (strncmp(a, "--", 2) == 0) {
+                const char* val = strchr(a, '=');
+                bool flag = strcmp(a, "--count") == 0 || strcmp(a, "--word") == 0 || strcmp(a, "--regex") == 0 ||
+                            strcmp(a, "--cache") == 0 || strcmp(a, "--highlight") == 0 || strcmp(a, "--kwic") == 0 ||
+                            strcmp(a, "--titles") == 0 || strcmp(a, "--stem") == 0 || strcmp(a, "--histogram") == 0 ||
+                            strcmp(a, "--stats") == 0;
+                if (val) val++;
+                else if (!flag && i + 1 < argc) val = argv[++i];
+                if (is_opt(a, "--limit") && val) pg.limit = atoi(val);
+                else if (is_opt(a, "--offset") && val) pg.offset = atoi(val);
+                else if (is_opt(a, "--after") && val) pg.from = (uint32_t)atoi(val) + 1;
+                else if (is_opt(a, "--context") && val) pg.context = atoi(val);
+                else if (strcmp(a, "--count") == 0) pg.count_only = true;
+                else if (strcmp(a, "--word") == 0) flags |= SEARCH_WORD;
+                else if (strcmp(a, "--regex") == 0) flags = (flags & ~SEARCH_QUERY) | SEARCH_REGEX;
+                else if (strcmp(a, "--stem") == 0) flags = (flags & ~SEARCH_QUERY) | SEARCH_STEM;
+                else if (is_opt(a, "--cache")) cache = val ? val : "";
+                else if (strcmp(a, "--highlight") == 0) pg.highlight = true;
+                else if (strcmp(a, "--stats") == 0) pg.stats = true;
+                else if (is_opt(a, "--kwic")) pg.kwic = val ? atoi(val) : KWIC_CONTEXT;
+                else if (strcmp(a, "--titles") == 0) continue;
+                else if (is_opt(a, "--histogram") && (!val || strcmp(val, "book") == 0)) hist = HIST_BOOK;
+                else if (is_opt(a, "--histogram") && strcmp(val, "chapter") == 0) hist = HIST_CHAPTER;
+                else { fprintf(stderr, "Unknown option: %s\n", a); return 1; }
+                continue;
+            }
+            if (!q.empty()) q += " ";
+            q += a;
+        }
+        // Stems already match by whole word, and a regex has no words to stem
+        if ((flags & SEARCH_STEM) && (flags & (SEARCH_WORD | SEARCH_REGEX))) {
+            fprintf(stderr, "Error: --stem cannot be used with --word or --regex\n");
+            return 1;
+        }
+        if (pg.limit < 0) pg.limit = 0;
+        if (pg.offset < 0) pg.offset = 0;
+        if (pg.context < 0) pg.context = 0;
+        if (pg.kwic < 0) pg.kwic = 0;
+        if (pg.kwic && pg.context) pg.context = 0; // snippets replace whole verses
+        if (pg.context && ntr) fprintf(stderr, "Warning: --context is ignored with --parallel\n");
+        if (cache) {
+            std::string dir = cache;
+            if (dir.empty()) {
+                const char* xdg = getenv("XDG_CACHE_HOME");
+                const char* home = getenv("HOME");
+                dir = xdg && *xdg ? std::string(xdg) + "/bible_reader" : std::string(home ? home : ".") + "/.cache/bible_reader";
+            }
+            if (!corpus.set_cache(dir.c_str(), CACHE_MAX_BYTES)) fprintf(stderr, "Warning: cache %s not usable\n", dir.c_str());
+        }
+        if (titles) search_titles(&corpus, q.c_str(), flags, &pg);
+        else if (hist >= 0) histogram(&corpus, q.c_str(), flags, hist);
+        else if (ntr) search_parallel(&corpus, q.c_str(), flags, &pg, tr, ntr);
+        else search(&corpus, q.c_str(), flags, &pg);
+    } else if (strcmp(command, "freq") == 0) {
+        int top = 20, by = FREQ_ALL;
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "--by=book") == 0) by = FREQ_BOOK;
+            else if (strcmp(argv[i], "--by=testament") == 0) by = FREQ_TESTAMENT;
+            else if (argv[i][0] != '-') top = atoi(argv[i]);
+            else { fprintf(stderr, "Unknown option: %s\n", argv[i]); return 1; }
+        }
+        freq(&corpus, top > 0 ? top : 0, by);
+    } else if (strcmp(command, "concordance") == 0 && argc > 2) {
+        concordance(&corpus, argv[2]);
+    }
+    out_flush();
+    close_translations(tr, ntr);
     return 0;
 }
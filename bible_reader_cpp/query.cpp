@@ -0,0 +1,382 @@
+// Boolean search queries:
+//
+//   dragoste AND NOT lege in:Ioan
+//   nt: har OR (pace AND in:Romani-Filimon)
+//   "fiul omului" in:Matei:5-7
+//
+// Operators are the upper case words AND, OR, NOT (NOT > AND > OR) and
+// parentheses; two items next to each other are ANDed. Plain words next to
+// each other stay one phrase, like a search without operators. Filters:
+// in:<Book>, in:<Book>-<Book>, in:<Book>:<ch>, in:<Book>:<ch>-<ch>, ot:, nt:
+// (book names ignore case, diacritics and spaces: in:1samuel).
+//
+// Books, chapters and testaments are contiguous verse ranges, so the planner
+// reduces the filters to a list of ranges and only those verses are decoded
+// and matched. On the xz stream nothing past the last range is decoded.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <string>
+#include <algorithm>
+#include "corpus_impl.h"
+
+#define OT_BOOKS 39
+#define NO_END UINT32_MAX
+
+enum { Q_TERM, Q_AND, Q_OR, Q_NOT, Q_SCOPE };
+
+struct Query {
+    int op;
+    std::string text;       // Q_TERM: folded phrase; Q_SCOPE: the filter as written
+    uint32_t lo, hi;        // Q_SCOPE verse range, once resolved
+    Query* a;
+    Query* b;
+};
+
+void query_free(Query* q) {
+    if (!q) return;
+    query_free(q->a);
+    query_free(q->b);
+    delete q;
+}
+
+static Query* node(int op, Query* a = NULL, Query* b = NULL) {
+    Query* q = new Query();
+    q->op = op;
+    q->a = a;
+    q->b = b;
+    return q;
+}
+
+// Tokenizer: ( ) AND OR NOT, filters, quoted phrases, runs of plain words
+enum { T_END, T_LPAREN, T_RPAREN, T_AND, T_OR, T_NOT, T_FILTER, T_PHRASE };
+
+struct Lexer {
+    const char* p;
+    int type;
+    std::string text;
+};
+
+static bool is_filter(const char* s) {
+    return strncasecmp(s, "in:", 3) == 0 || strncasecmp(s, "ot:", 3) == 0 || strncasecmp(s, "nt:", 3) == 0;
+}
+
+static size_t word_len(const char* s) {
+    size_t n = 0;
+    while (s[n] && !isspace((unsigned char)s[n]) && s[n] != '(' && s[n] != ')' && s[n] != '"') n++;
+    return n;
+}
+
+static bool is_keyword(const char* s, size_t n) {
+    return (n == 3 && strncmp(s, "AND", 3) == 0) || (n == 2 && strncmp(s, "OR", 2) == 0) || (n == 3 && strncmp(s, "NOT", 3) == 0);
+}
+
+static void lex(Lexer* lx) {
+    while (isspace((unsigned char)*lx->p)) lx->p++;
+    lx->text.clear();
+    const char* s = lx->p;
+    if (!*s) { lx->type = T_END; return; }
+    if (*s == '(' || *s == ')') {
+        lx->type = *s == '(' ? T_LPAREN : T_RPAREN;
+        lx->p++;
+        return;
+    }
+    if (*s == '"') {
+        const char* e = strchr(s + 1, '"');
+        if (!e) e = s + strlen(s);
+        lx->text.assign(s + 1, e - s - 1);
+        lx->type = T_PHRASE;
+        lx->p = *e ? e + 1 : e;
+        return;
+    }
+    size_t n = word_len(s);
+    if (is_keyword(s, n)) {
+        lx->type = s[0] == 'A' ? T_AND : s[0] == 'O' ? T_OR : T_NOT;
+        lx->p += n;
+        return;
+    }
+    if (is_filter(s)) {
+        // "nt:har" is the filter followed by a word
+        size_t len = strncasecmp(s, "in:", 3) == 0 ? n : 3;
+        lx->text.assign(s, len);
+        lx->type = T_FILTER;
+        lx->p += len;
+        return;
+    }
+    // Plain words up to the next operator, filter, quote or parenthesis
+    lx->type = T_PHRASE;
+    for (;;) {
+        if (!lx->text.empty()) lx->text += ' ';
+        lx->text.append(lx->p, n);
+        lx->p += n;
+        const char* q = lx->p;
+        while (isspace((unsigned char)*q)) q++;
+        size_t m = word_len(q);
+        if (m == 0 || is_keyword(q, m) || is_filter(q)) break;
+        lx->p = q;
+        n = m;
+    }
+}
+
+struct QParser {
+    Lexer lx;
+    char* err;
+    size_t errlen;
+    bool failed;
+};
+
+static Query* qfail(QParser* ps, const char* msg) {
+    if (!ps->failed) snprintf(ps->err, ps->errlen, "%s", msg);
+    ps->failed = true;
+    return NULL;
+}
+
+static Query* parse_or(QParser* ps);
+
+static Query* parse_primary(QParser* ps) {
+    Lexer* lx = &ps->lx;
+    if (lx->type == T_LPAREN) {
+        lex(lx);
+        Query* q = parse_or(ps);
+        if (!q) return NULL;
+        if (lx->type != T_RPAREN) { query_free(q); return qfail(ps, "missing )"); }
+        lex(lx);
+        return q;
+    }
+    if (lx->type == T_PHRASE || lx->type == T_FILTER) {
+        Query* q = node(lx->type == T_PHRASE ? Q_TERM : Q_SCOPE);
+        if (q->op == Q_TERM) {
+            char buf[MAX_LINE * 2];
+            if (lx->text.size() >= MAX_LINE) { query_free(q); return qfail(ps, "query too long"); }
+            normalize_into(lx->text.c_str(), buf);
+            q->text = buf;
+        } else {
+            q->text = lx->text;
+        }
+        lex(lx);
+        return q;
+    }
+    return qfail(ps, lx->type == T_END ? "query ends too early" : "unexpected operator");
+}
+
+static Query* parse_not(QParser* ps) {
+    if (ps->lx.type != T_NOT) return parse_primary(ps);
+    lex(&ps->lx);
+    Query* q = parse_not(ps);
+    return q ? node(Q_NOT, q) : NULL;
+}
+
+static Query* parse_and(QParser* ps) {
+    Query* q = parse_not(ps);
+    while (q) {
+        int t = ps->lx.type;
+        if (t == T_AND) lex(&ps->lx);
+        else if (t != T_NOT && t != T_LPAREN && t != T_PHRASE && t != T_FILTER) break;
+        Query* r = parse_not(ps);
+        if (!r) { query_free(q); return NULL; }
+        q = node(Q_AND, q, r);
+    }
+    return q;
+}
+
+static Query* parse_or(QParser* ps) {
+    Query* q = parse_and(ps);
+    while (q && ps->lx.type == T_OR) {
+        lex(&ps->lx);
+        Query* r = parse_and(ps);
+        if (!r) { query_free(q); return NULL; }
+        q = node(Q_OR, q, r);
+    }
+    return q;
+}
+
+Query* query_parse(const char* text, char* err, size_t errlen) {
+    QParser ps;
+    ps.lx.p = text;
+    ps.err = err;
+    ps.errlen = errlen;
+    ps.failed = false;
+    lex(&ps.lx);
+    if (ps.lx.type == T_PHRASE) {
+        // A lone phrase is a plain search, leave it to the fast paths
+        Lexer peek = ps.lx;
+        lex(&peek);
+        if (peek.type == T_END && text[strspn(text, " \t")] != '"') return NULL;
+    }
+    Query* q = parse_or(&ps);
+    if (q && ps.lx.type != T_END) {
+        query_free(q);
+        return qfail(&ps, ps.lx.type == T_RPAREN ? "unmatched )" : "unexpected token");
+    }
+    return q;
+}
+
+// Planner
+
+static void compact(const char* s, char* out) {
+    char buf[MAX_LINE * 2];
+    normalize_into(s, buf);
+    for (const char* p = buf; *p; p++)
+        if (*p != ' ' && *p != '_') *out++ = *p;
+    *out = 0;
+}
+
+static int find_book_loose(Corpus::Impl* c, const std::string& name) {
+    char want[MAX_LINE * 2], have[MAX_LINE * 2];
+    compact(name.c_str(), want);
+    for (size_t b = 0;; b++) {
+        ensure_books(c, b + 1);
+        if (b >= c->books.size()) return 0;
+        compact(c->books[b].name, have);
+        if (strcmp(want, have) == 0) return (int)b + 1;
+    }
+}
+
+// First verse of global chapter g, or the end of the corpus past the last one
+static uint32_t chapter_start(Corpus::Impl* c, size_t g) {
+    if (!g) return 0; // the stream may not have reached it yet
+    ensure_chapter(c, g - 1);
+    return g < c->chapter_first.size() ? c->chapter_first[g] : c->complete ? c->nverses : NO_END;
+}
+
+// First verse of book b (1-based), or the end of the corpus past the last book
+static uint32_t book_start(Corpus::Impl* c, int b) {
+    ensure_books(c, b);
+    if (b > (int)c->books.size()) return NO_END;
+    return chapter_start(c, c->books[b - 1].first_chapter);
+}
+
+// Verse range of a filter; false (and err) when it names nothing
+static bool resolve(Corpus::Impl* c, Query* q, char* err, size_t errlen) {
+    const char* f = q->text.c_str();
+    if (strncasecmp(f, "ot:", 3) == 0 || strncasecmp(f, "nt:", 3) == 0) {
+        uint32_t nt = book_start(c, OT_BOOKS + 1);
+        q->lo = tolower(f[0]) == 'o' ? 0 : nt;
+        q->hi = tolower(f[0]) == 'o' ? nt : NO_END;
+        return true;
+    }
+    // in:<book>[-<book>][:<ch>[-<ch>]]
+    std::string spec(f + 3), books = spec, chapters;
+    size_t colon = spec.find(':');
+    if (colon != std::string::npos) {
+        books = spec.substr(0, colon);
+        chapters = spec.substr(colon + 1);
+    }
+    size_t dash = books.find('-');
+    std::string first = books.substr(0, dash);
+    int b1 = find_book_loose(c, first), b2 = b1;
+    if (dash != std::string::npos) b2 = find_book_loose(c, books.substr(dash + 1));
+    if (!b1 || !b2 || b2 < b1) {
+        snprintf(err, errlen, "unknown book: %s", f);
+        return false;
+    }
+    if (chapters.empty()) {
+        q->lo = book_start(c, b1);
+        q->hi = book_start(c, b2 + 1);
+        return true;
+    }
+    int c1 = atoi(chapters.c_str()), c2 = c1;
+    size_t cd = chapters.find('-');
+    if (cd != std::string::npos) c2 = atoi(chapters.c_str() + cd + 1);
+    ensure_books(c, b1 + 1); // all chapters of b1 known
+    const BookInfo* bi = &c->books[b1 - 1];
+    if (b1 != b2 || c1 < 1 || c2 < c1 || c2 > (int)bi->nchapters) {
+        snprintf(err, errlen, "bad chapter range: %s", f);
+        return false;
+    }
+    q->lo = chapter_start(c, bi->first_chapter + c1 - 1);
+    q->hi = chapter_start(c, bi->first_chapter + c2);
+    return true;
+}
+
+// Verses the query can match at all: filters narrow it, terms don't
+static bool plan(Corpus::Impl* c, Query* q, Ranges* out, char* err, size_t errlen) {
+    Ranges a, b;
+    out->clear();
+    switch (q->op) {
+    case Q_SCOPE:
+        if (!resolve(c, q, err, errlen)) return false;
+        if (q->lo < q->hi) out->push_back(std::make_pair(q->lo, q->hi));
+        return true;
+    case Q_AND:
+        if (!plan(c, q->a, &a, err, errlen) || !plan(c, q->b, &b, err, errlen)) return false;
+        for (size_t i = 0, j = 0; i < a.size() && j < b.size();) {
+            uint32_t lo = std::max(a[i].first, b[j].first), hi = std::min(a[i].second, b[j].second);
+            if (lo < hi) out->push_back(std::make_pair(lo, hi));
+            if (a[i].second < b[j].second) i++; else j++;
+        }
+        return true;
+    case Q_OR:
+        if (!plan(c, q->a, &a, err, errlen) || !plan(c, q->b, &b, err, errlen)) return false;
+        a.insert(a.end(), b.begin(), b.end());
+        std::sort(a.begin(), a.end());
+        for (size_t i = 0; i < a.size(); i++) {
+            if (!out->empty() && a[i].first <= out->back().second) out->back().second = std::max(out->back().second, a[i].second);
+            else out->push_back(a[i]);
+        }
+        return true;
+    case Q_NOT:
+        // Filters under NOT are still resolved (and checked), the scope stays whole
+        if (!plan(c, q->a, &a, err, errlen)) return false;
+        out->push_back(std::make_pair(0u, NO_END));
+        return true;
+    default:
+        out->push_back(std::make_pair(0u, NO_END));
+        return true;
+    }
+}
+
+static bool eval(const Query* q, uint32_t i, const char* folded, bool whole_word) {
+    switch (q->op) {
+    case Q_TERM: return whole_word ? word_match(folded, q->text.c_str()) : strstr(folded, q->text.c_str()) != NULL;
+    case Q_SCOPE: return i >= q->lo && i < q->hi;
+    case Q_AND: return eval(q->a, i, folded, whole_word) && eval(q->b, i, folded, whole_word);
+    case Q_OR: return eval(q->a, i, folded, whole_word) || eval(q->b, i, folded, whole_word);
+    default: return !eval(q->a, i, folded, whole_word);
+    }
+}
+
+bool query_plan(Corpus::Impl* c, Query* q, Ranges* scope) { return plan(c, q, scope, c->error, sizeof(c->error)); }
+
+bool query_match(const Query* q, uint32_t i, const char* folded, bool whole_word) { return eval(q, i, folded, whole_word); }
+
+void query_spans(const Query* q, const char* folded, bool whole_word, std::vector<uint32_t>* spans) {
+    switch (q->op) {
+    case Q_TERM: term_spans(folded, q->text.c_str(), whole_word, spans); break;
+    case Q_AND: case Q_OR:
+        query_spans(q->a, folded, whole_word, spans);
+        query_spans(q->b, folded, whole_word, spans);
+        break;
+    default: break; // filters cover whole verses, NOT terms are absent
+    }
+}
+
+size_t query_find(Corpus::Impl* c, Query* q, bool whole_word, uint32_t after, uint32_t* ids, size_t cap) {
+    Ranges scope;
+    if (!plan(c, q, &scope, c->error, sizeof(c->error))) return 0;
+
+    char buf[MAX_LINE * 2 + 8], norm[MAX_LINE * 2];
+    size_t n = 0;
+    for (size_t r = 0; r < scope.size() && (n < cap || !ids); r++) {
+        for (uint32_t i = std::max(after, scope[r].first); i < scope[r].second && (n < cap || !ids); i++) {
+            // Folded text from the shadow when it already covers the verse,
+            // otherwise decode and fold just this one
+            const char* folded;
+            if (i < c->shadow.text.size()) {
+                folded = c->shadow.text[i];
+            } else {
+                ensure_verse(c, i);
+                if (i >= c->nverses) return n;
+                normalize_into(scan_text(c, i, buf), norm);
+                folded = norm;
+            }
+            if (eval(q, i, folded, whole_word)) {
+                if (ids) ids[n] = i;
+                n++;
+            }
+        }
+    }
+    return n;
+}
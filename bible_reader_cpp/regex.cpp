@@ -0,0 +1,737 @@
+// Small regex engine for `search --regex`: the pattern is parsed into a tree,
+// compiled to a Thompson NFA over bytes, and run as a DFA whose states are
+// built lazily the first time a (state, byte) pair is seen. No backtracking,
+// so every verse costs one table lookup per byte.
+//
+// Literals are folded like normalize() so they match the shadow text. The
+// <span> markup is invisible to the matcher. \b and \B follow word_match():
+// multibyte letters are word characters, „ ” – … (E2 xx xx) are not.
+//
+// Supported: literals, . [] [^] \d \w \s \D \W \S \b \B ^ $ | () (?:)
+// * + ? {m} {m,} {m,n}
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <algorithm>
+#include <map>
+#include <string>
+#include "corpus_impl.h"
+
+#define RE_MAX_INST 20000
+#define RE_MAX_REPEAT 1000
+#define RE_MAX_STATES 2048      // DFA cache size, flushed when full
+
+enum { N_RANGE, N_CAT, N_ALT, N_REP, N_ASSERT };
+enum { A_NONE, A_BOL, A_EOL, A_WORD, A_NOT_WORD };
+enum { I_RANGE, I_SPLIT, I_EMPTY, I_MATCH };
+
+struct Node {
+    int type;
+    uint8_t lo, hi;
+    int kind;           // N_ASSERT
+    int min, max;       // N_REP, max -1 for no limit
+    std::vector<Node*> kids;
+};
+
+struct Inst {
+    uint8_t op, lo, hi, kind;
+    int out, out1;
+};
+
+// DFA state flags: previous character was a word character, at verse start
+#define F_WORD 1
+#define F_BOL 2
+
+struct DState {
+    std::vector<int> set;   // RANGE / MATCH / pending assertion instructions
+    uint8_t flags;
+    int8_t end_match;       // -1 not known yet
+};
+
+#define D_MATCH -2
+#define D_UNKNOWN -1
+
+struct Regex {
+    std::vector<Inst> prog;
+    int start;
+    std::vector<DState> states;
+    uint8_t cls[256];       // bytes no instruction or \\b tells apart share a class
+    int nclass;
+    std::vector<int> next;  // nclass per state, entries are state * nclass
+    std::map<std::string, int> cache;
+    int start_state;
+    unsigned flushes;
+    std::vector<unsigned> mark;
+    unsigned gen;
+    std::string literal;    // prefilter, see required()
+};
+
+// Parser
+
+struct Parser {
+    const char* p;
+    std::vector<Node*> nodes;
+    char* err;
+    size_t errlen;
+    bool failed;
+};
+
+static Node* new_node(Parser* ps, int type) {
+    Node* n = new Node();
+    n->type = type;
+    ps->nodes.push_back(n);
+    return n;
+}
+
+static Node* fail(Parser* ps, const char* msg) {
+    if (!ps->failed) snprintf(ps->err, ps->errlen, "%s", msg);
+    ps->failed = true;
+    return NULL;
+}
+
+static Node* range(Parser* ps, int lo, int hi) {
+    Node* n = new_node(ps, N_RANGE);
+    n->lo = lo;
+    n->hi = hi;
+    return n;
+}
+
+static Node* cat2(Parser* ps, Node* a, Node* b) {
+    Node* n = new_node(ps, N_CAT);
+    n->kids.push_back(a);
+    n->kids.push_back(b);
+    return n;
+}
+
+// One multibyte character whose lead byte is in [lo, hi]
+static Node* multibyte(Parser* ps, int lo, int hi) {
+    Node* cont = new_node(ps, N_REP);
+    cont->kids.push_back(range(ps, 0x80, 0xBF));
+    cont->min = 0;
+    cont->max = -1;
+    return cat2(ps, range(ps, lo, hi), cont);
+}
+
+// ASCII set plus which multibyte characters go with it
+struct CharSet {
+    bool ascii[128];
+    bool mb_all;        // any multibyte character
+    bool mb_word;       // multibyte letters (everything but E2 xx xx)
+    bool mb_punct;      // E2 xx xx
+    std::vector<std::string> seqs;
+};
+
+static Node* charset_node(Parser* ps, const CharSet* cs) {
+    Node* alt = new_node(ps, N_ALT);
+    for (int c = 1; c < 128; c++) {
+        if (!cs->ascii[c]) continue;
+        int lo = c;
+        while (c + 1 < 128 && cs->ascii[c + 1]) c++;
+        alt->kids.push_back(range(ps, lo, c));
+    }
+    if (cs->mb_all || (cs->mb_word && cs->mb_punct)) {
+        alt->kids.push_back(multibyte(ps, 0xC0, 0xFF));
+    } else {
+        if (cs->mb_word) {
+            alt->kids.push_back(multibyte(ps, 0xC0, 0xE1));
+            alt->kids.push_back(multibyte(ps, 0xE3, 0xFF));
+        }
+        if (cs->mb_punct) alt->kids.push_back(multibyte(ps, 0xE2, 0xE2));
+    }
+    for (size_t i = 0; i < cs->seqs.size(); i++) {
+        Node* cat = new_node(ps, N_CAT);
+        for (size_t k = 0; k < cs->seqs[i].size(); k++) {
+            unsigned char b = cs->seqs[i][k];
+            cat->kids.push_back(range(ps, b, b));
+        }
+        alt->kids.push_back(cat);
+    }
+    if (alt->kids.empty()) return fail(ps, "empty character class");
+    return alt;
+}
+
+static void set_range(CharSet* cs, int lo, int hi) {
+    for (int c = lo; c <= hi; c++) cs->ascii[c] = true;
+}
+
+// \d \w \s and their negations into cs; false if e is not a class escape
+static bool class_escape(CharSet* cs, char e) {
+    CharSet t;
+    memset(t.ascii, 0, sizeof(t.ascii));
+    t.mb_all = t.mb_word = t.mb_punct = false;
+    switch (tolower((unsigned char)e)) {
+    case 'd': set_range(&t, '0', '9'); break;
+    case 'w': set_range(&t, '0', '9'); set_range(&t, 'a', 'z'); set_range(&t, 'A', 'Z'); t.mb_word = true; break;
+    case 's': t.ascii[(int)' '] = t.ascii[(int)'\t'] = true; break;
+    default: return false;
+    }
+    bool neg = isupper((unsigned char)e);
+    for (int c = 1; c < 128; c++)
+        if (t.ascii[c] != neg) cs->ascii[c] = true;
+    if (neg) {
+        if (!t.mb_word) cs->mb_word = true;
+        cs->mb_punct = true;
+    } else {
+        cs->mb_word |= t.mb_word;
+    }
+    return true;
+}
+
+// Reads one (possibly multibyte) character of the pattern and folds it
+static std::string fold_char(Parser* ps) {
+    const unsigned char* s = (const unsigned char*)ps->p;
+    size_t len = s[0] < 0x80 ? 1 : s[0] >= 0xF0 ? 4 : s[0] >= 0xE0 ? 3 : 2;
+    size_t n = strnlen(ps->p, len);
+    char raw[8], out[16];
+    memcpy(raw, ps->p, n);
+    raw[n] = 0;
+    ps->p += n;
+    size_t m = normalize_into(raw, out);
+    return std::string(out, m);
+}
+
+static Node* literal(Parser* ps, const std::string& s) {
+    if (s.size() == 1) return range(ps, (unsigned char)s[0], (unsigned char)s[0]);
+    Node* cat = new_node(ps, N_CAT);
+    for (size_t i = 0; i < s.size(); i++) cat->kids.push_back(range(ps, (unsigned char)s[i], (unsigned char)s[i]));
+    return cat;
+}
+
+static Node* parse_class(Parser* ps) {
+    CharSet cs;
+    memset(cs.ascii, 0, sizeof(cs.ascii));
+    cs.mb_all = cs.mb_word = cs.mb_punct = false;
+    bool neg = false;
+    if (*ps->p == '^') { neg = true; ps->p++; }
+    bool first = true;
+    while (*ps->p && (*ps->p != ']' || first)) {
+        first = false;
+        std::string lo;
+        if (*ps->p == '\\' && ps->p[1]) {
+            if (class_escape(&cs, ps->p[1])) { ps->p += 2; continue; }
+            ps->p++;
+        }
+        lo = fold_char(ps);
+        if (*ps->p == '-' && ps->p[1] && ps->p[1] != ']') {
+            ps->p++;
+            if (*ps->p == '\\' && ps->p[1]) ps->p++;
+            std::string hi = fold_char(ps);
+            if (lo.size() != 1 || hi.size() != 1 || (unsigned char)lo[0] >= 0x80 || (unsigned char)hi[0] >= 0x80)
+                return fail(ps, "ranges must be ASCII");
+            if (lo[0] > hi[0]) return fail(ps, "bad range in character class");
+            set_range(&cs, lo[0], hi[0]);
+        } else if (lo.size() == 1 && (unsigned char)lo[0] < 0x80) {
+            cs.ascii[(unsigned char)lo[0]] = true;
+        } else {
+            cs.seqs.push_back(lo);
+        }
+    }
+    if (*ps->p != ']') return fail(ps, "missing ]");
+    ps->p++;
+    if (neg) {
+        // Negated sets only exclude ASCII characters; any multibyte one matches
+        for (int c = 1; c < 128; c++) cs.ascii[c] = !cs.ascii[c];
+        cs.mb_all = true;
+        cs.seqs.clear();
+    }
+    return charset_node(ps, &cs);
+}
+
+static Node* parse_alt(Parser* ps);
+
+static Node* parse_atom(Parser* ps) {
+    char c = *ps->p;
+    if (c == '(') {
+        ps->p++;
+        if (ps->p[0] == '?' && ps->p[1] == ':') ps->p += 2;
+        Node* n = parse_alt(ps);
+        if (*ps->p != ')') return fail(ps, "missing )");
+        ps->p++;
+        return n;
+    }
+    if (c == '[') {
+        ps->p++;
+        return parse_class(ps);
+    }
+    if (c == '.') {
+        ps->p++;
+        CharSet cs;
+        memset(cs.ascii, 1, sizeof(cs.ascii));
+        cs.mb_all = true;
+        cs.mb_word = cs.mb_punct = false;
+        return charset_node(ps, &cs);
+    }
+    if (c == '^' || c == '$') {
+        ps->p++;
+        Node* n = new_node(ps, N_ASSERT);
+        n->kind = c == '^' ? A_BOL : A_EOL;
+        return n;
+    }
+    if (c == '\\') {
+        char e = ps->p[1];
+        if (!e) return fail(ps, "trailing \\");
+        if (e == 'b' || e == 'B') {
+            ps->p += 2;
+            Node* n = new_node(ps, N_ASSERT);
+            n->kind = e == 'b' ? A_WORD : A_NOT_WORD;
+            return n;
+        }
+        CharSet cs;
+        memset(cs.ascii, 0, sizeof(cs.ascii));
+        cs.mb_all = cs.mb_word = cs.mb_punct = false;
+        if (class_escape(&cs, e)) {
+            ps->p += 2;
+            return charset_node(ps, &cs);
+        }
+        ps->p++;
+        if (e == 't') { ps->p++; return range(ps, '\t', '\t'); }
+        return literal(ps, fold_char(ps));
+    }
+    if (c == '*' || c == '+' || c == '?' || c == '{') return fail(ps, "nothing to repeat");
+    return literal(ps, fold_char(ps));
+}
+
+static bool parse_count(Parser* ps, int* min, int* max) {
+    const char* s = ps->p + 1;
+    if (!isdigit((unsigned char)*s)) return false;
+    *min = strtol(s, (char**)&s, 10);
+    *max = *min;
+    if (*s == ',') {
+        s++;
+        *max = isdigit((unsigned char)*s) ? strtol(s, (char**)&s, 10) : -1;
+    }
+    if (*s != '}') return false;
+    ps->p = s + 1;
+    return true;
+}
+
+static Node* parse_repeat(Parser* ps) {
+    Node* n = parse_atom(ps);
+    while (n) {
+        int min, max;
+        char c = *ps->p;
+        if (c == '*') { min = 0; max = -1; ps->p++; }
+        else if (c == '+') { min = 1; max = -1; ps->p++; }
+        else if (c == '?') { min = 0; max = 1; ps->p++; }
+        else if (c == '{' && parse_count(ps, &min, &max)) {
+            if (min > RE_MAX_REPEAT || max > RE_MAX_REPEAT || (max >= 0 && max < min)) return fail(ps, "bad repeat count");
+        } else break;
+        if (*ps->p == '?') ps->p++; // lazy makes no difference for a yes/no match
+        Node* r = new_node(ps, N_REP);
+        r->kids.push_back(n);
+        r->min = min;
+        r->max = max;
+        n = r;
+    }
+    return n;
+}
+
+static Node* parse_cat(Parser* ps) {
+    Node* cat = new_node(ps, N_CAT);
+    while (*ps->p && *ps->p != '|' && *ps->p != ')') {
+        Node* n = parse_repeat(ps);
+        if (!n) return NULL;
+        cat->kids.push_back(n);
+    }
+    return cat;
+}
+
+static Node* parse_alt(Parser* ps) {
+    Node* alt = new_node(ps, N_ALT);
+    for (;;) {
+        Node* n = parse_cat(ps);
+        if (!n) return NULL;
+        alt->kids.push_back(n);
+        if (*ps->p != '|') break;
+        ps->p++;
+    }
+    return alt->kids.size() == 1 ? alt->kids[0] : alt;
+}
+
+// Compiler: each node is compiled in front of the instruction it continues
+// to, so no patch lists are needed. Repeats get a fresh copy per count.
+
+static int emit(Regex* re, int op, int out, int out1 = -1) {
+    Inst in = { (uint8_t)op, 0, 0, 0, out, out1 };
+    re->prog.push_back(in);
+    return (int)re->prog.size() - 1;
+}
+
+static int compile(Regex* re, const Node* n, int next) {
+    if ((int)re->prog.size() > RE_MAX_INST) return -1;
+    switch (n->type) {
+    case N_RANGE: {
+        int pc = emit(re, I_RANGE, next);
+        re->prog[pc].lo = n->lo;
+        re->prog[pc].hi = n->hi;
+        return pc;
+    }
+    case N_ASSERT: {
+        int pc = emit(re, I_EMPTY, next);
+        re->prog[pc].kind = n->kind;
+        return pc;
+    }
+    case N_CAT:
+        for (size_t i = n->kids.size(); i-- > 0;)
+            if ((next = compile(re, n->kids[i], next)) < 0) return -1;
+        return next;
+    case N_ALT: {
+        int s = compile(re, n->kids.back(), next);
+        for (size_t i = n->kids.size() - 1; s >= 0 && i-- > 0;) {
+            int k = compile(re, n->kids[i], next);
+            if (k < 0) return -1;
+            s = emit(re, I_SPLIT, k, s);
+        }
+        return s;
+    }
+    default: { // N_REP
+        int s;
+        if (n->max < 0) {
+            s = emit(re, I_SPLIT, -1, next);
+            int body = compile(re, n->kids[0], s);
+            if (body < 0) return -1;
+            re->prog[s].out = body;
+        } else {
+            s = next;
+            for (int k = n->min; k < n->max && s >= 0; k++) {
+                int body = compile(re, n->kids[0], s);
+                if (body < 0) return -1;
+                s = emit(re, I_SPLIT, body, next);
+            }
+        }
+        for (int k = 0; k < n->min && s >= 0; k++) s = compile(re, n->kids[0], s);
+        return s;
+    }
+    }
+}
+
+static bool word_char(unsigned char c) { return is_word_byte(c) && c != 0xE2; }
+
+// Exact string n matches, if it only matches one
+static bool exact(const Node* n, std::string* out) {
+    switch (n->type) {
+    case N_RANGE:
+        if (n->lo != n->hi) return false;
+        *out += (char)n->lo;
+        return true;
+    case N_ASSERT:
+        return true;
+    case N_CAT:
+        for (size_t i = 0; i < n->kids.size(); i++)
+            if (!exact(n->kids[i], out)) return false;
+        return true;
+    case N_REP:
+        if (n->min != n->max) return false;
+        for (int k = 0; k < n->min; k++)
+            if (!exact(n->kids[0], out)) return false;
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Longest string every match of n contains
+static std::string required(const Node* n) {
+    std::string best, run;
+    if (n->type == N_REP) return n->min > 0 ? required(n->kids[0]) : best;
+    if (n->type != N_CAT) {
+        if (!exact(n, &best)) best.clear();
+        return best;
+    }
+    for (size_t i = 0; i < n->kids.size(); i++) {
+        std::string e;
+        if (exact(n->kids[i], &e)) {
+            run += e;
+            continue;
+        }
+        if (run.size() > best.size()) best = run;
+        run.clear();
+        std::string r = required(n->kids[i]);
+        if (r.size() > best.size()) best = r;
+    }
+    return run.size() > best.size() ? run : best;
+}
+
+// The longest run of word characters in s. Markup never sits inside a word
+// in this corpus, so such a run is found by memmem in the raw folded text
+// even though the matcher skips the tags.
+static std::string longest_word(const std::string& s) {
+    std::string best;
+    size_t i = 0;
+    while (i < s.size()) {
+        unsigned char c = s[i];
+        if (!word_char(c) || (c & 0xC0) == 0x80) {
+            i += c == 0xE2 ? 3 : 1;
+            continue;
+        }
+        size_t j = i;
+        while (j < s.size() && word_char(s[j]) ) j++;
+        if (j - i > best.size()) best = s.substr(i, j - i);
+        i = j;
+    }
+    return best;
+}
+
+static void byte_classes(Regex* re) {
+    bool cut[257] = { false };
+    for (size_t i = 0; i < re->prog.size(); i++) {
+        if (re->prog[i].op != I_RANGE) continue;
+        cut[re->prog[i].lo] = true;
+        cut[re->prog[i].hi + 1] = true;
+    }
+    // Word character and continuation byte edges, for \\b
+    const int edges[] = { '0', '9' + 1, 'A', 'Z' + 1, 'a', 'z' + 1, 0x80, 0xC0, 0xE2, 0xE3 };
+    for (size_t i = 0; i < sizeof(edges) / sizeof(edges[0]); i++) cut[edges[i]] = true;
+    int k = 0;
+    for (int c = 0; c < 256; c++) {
+        if (c > 0 && cut[c]) k++;
+        re->cls[c] = k;
+    }
+    re->nclass = k + 1;
+}
+
+Regex* re_compile(const char* pattern, char* err, size_t errlen) {
+    Parser ps;
+    ps.p = pattern;
+    ps.err = err;
+    ps.errlen = errlen;
+    ps.failed = false;
+    Node* root = parse_alt(&ps);
+    if (root && *ps.p == ')') root = fail(&ps, "unmatched )");
+
+    Regex* re = NULL;
+    if (root) {
+        re = new Regex;
+        int match = emit(re, I_MATCH, -1);
+        re->start = compile(re, root, match);
+        if (re->start < 0) {
+            fail(&ps, "pattern too large");
+            delete re;
+            re = NULL;
+        } else {
+            byte_classes(re);
+            re->literal = longest_word(required(root));
+            if (re->literal.size() < 3) re->literal.clear();
+            re->start_state = D_UNKNOWN;
+            re->flushes = 0;
+            re->mark.assign(re->prog.size(), 0);
+            re->gen = 0;
+        }
+    }
+    for (size_t i = 0; i < ps.nodes.size(); i++) delete ps.nodes[i];
+    return re;
+}
+
+void re_free(Regex* re) { delete re; }
+
+const char* re_literal(Regex* re) { return re->literal.c_str(); }
+
+// DFA
+
+// Assertions still pending in a state are decided once the next byte is seen
+struct Ctx {
+    bool prev_word, bol, next_word, eol;
+};
+
+static bool assert_ok(int kind, const Ctx* x) {
+    switch (kind) {
+    case A_BOL: return x->bol;
+    case A_EOL: return x->eol;
+    case A_WORD: return x->prev_word != x->next_word;
+    case A_NOT_WORD: return x->prev_word == x->next_word;
+    default: return true;
+    }
+}
+
+// Adds pc and everything reachable without input. Without a context,
+// assertions are kept in the set for later; with one they are decided.
+static void add_pc(Regex* re, std::vector<int>* set, int pc, const Ctx* x) {
+    if (re->mark[pc] == re->gen) return;
+    re->mark[pc] = re->gen;
+    const Inst* in = &re->prog[pc];
+    if (in->op == I_SPLIT) {
+        add_pc(re, set, in->out, x);
+        add_pc(re, set, in->out1, x);
+    } else if (in->op == I_EMPTY && (in->kind == A_NONE || x)) {
+        if (assert_ok(in->kind, x)) add_pc(re, set, in->out, x);
+    } else {
+        set->push_back(pc);
+    }
+}
+
+static void flush(Regex* re) {
+    re->states.clear();
+    re->next.clear();
+    re->cache.clear();
+    re->start_state = D_UNKNOWN;
+    re->flushes++;
+}
+
+static int dstate(Regex* re, std::vector<int>& set, uint8_t flags) {
+    std::string key((const char*)&flags, 1);
+    key.append((const char*)set.data(), set.size() * sizeof(int));
+    std::map<std::string, int>::iterator it = re->cache.find(key);
+    if (it != re->cache.end()) return it->second;
+    if (re->states.size() >= RE_MAX_STATES) flush(re);
+    DState d;
+    d.set.swap(set);
+    d.flags = flags;
+    d.end_match = -1;
+    re->states.push_back(d);
+    re->next.resize(re->states.size() * re->nclass, D_UNKNOWN);
+    int id = ((int)re->states.size() - 1) * re->nclass;
+    re->cache[key] = id;
+    return id;
+}
+
+static int start_state(Regex* re) {
+    if (re->start_state == D_UNKNOWN) {
+        std::vector<int> set;
+        re->gen++;
+        add_pc(re, &set, re->start, NULL);
+        re->start_state = dstate(re, set, F_BOL);
+    }
+    return re->start_state;
+}
+
+// Resolves the pending assertions of state s in context x; true on a match
+static bool expand(Regex* re, int s, const Ctx* x, std::vector<int>* out) {
+    re->gen++;
+    const std::vector<int>& set = re->states[s / re->nclass].set;
+    for (size_t i = 0; i < set.size(); i++) add_pc(re, out, set[i], x);
+    for (size_t i = 0; i < out->size(); i++)
+        if (re->prog[(*out)[i]].op == I_MATCH) return true;
+    return false;
+}
+
+static int step(Regex* re, int s, unsigned char c) {
+    uint8_t flags = re->states[s / re->nclass].flags;
+    bool cont = (c & 0xC0) == 0x80; // no boundary inside a character
+    Ctx x = { (flags & F_WORD) != 0, (flags & F_BOL) != 0, cont ? (flags & F_WORD) != 0 : word_char(c), false };
+    std::vector<int> cur, next;
+    if (expand(re, s, &x, &cur)) return re->next[s + re->cls[c]] = D_MATCH;
+
+    re->gen++;
+    for (size_t i = 0; i < cur.size(); i++) {
+        const Inst* in = &re->prog[cur[i]];
+        if (in->op == I_RANGE && c >= in->lo && c <= in->hi) add_pc(re, &next, in->out, NULL);
+    }
+    add_pc(re, &next, re->start, NULL); // unanchored: a match may start anywhere
+    std::sort(next.begin(), next.end());
+    uint8_t nflags = x.next_word ? F_WORD : 0;
+    unsigned flushes = re->flushes;
+    int t = dstate(re, next, nflags);
+    // After a flush s is gone, so there is no row to fill in
+    if (re->flushes == flushes) re->next[s + re->cls[c]] = t;
+    return t;
+}
+
+static bool end_match(Regex* re, int s) {
+    DState* d = &re->states[s / re->nclass];
+    if (d->end_match < 0) {
+        Ctx x = { (d->flags & F_WORD) != 0, (d->flags & F_BOL) != 0, false, true };
+        std::vector<int> cur;
+        bool m = expand(re, s, &x, &cur);
+        re->states[s / re->nclass].end_match = m;
+    }
+    return re->states[s / re->nclass].end_match;
+}
+
+bool re_match(Regex* re, const char* text) {
+    int s = start_state(re);
+    const uint8_t* cls = re->cls;
+    const int* next = re->next.data(); // moves when step() adds states
+    for (const unsigned char* p = (const unsigned char*)text; *p; p++) {
+        if (*p == '<') {
+            // Markup is invisible to the pattern
+            const unsigned char* gt = (const unsigned char*)strchr((const char*)p, '>');
+            if (gt) { p = gt; continue; }
+        }
+        int t = next[s + cls[*p]];
+        if (t < 0) {
+            if (t == D_UNKNOWN) t = step(re, s, *p);
+            if (t == D_MATCH) return true;
+            next = re->next.data();
+        }
+        s = t;
+    }
+    return end_match(re, s);
+}
+
+// Match spans for highlighting: a Pike VM over the same program. Every thread
+// carries the offset it started at, so the leftmost-longest match comes out
+// of one pass; matches don't overlap and are never empty.
+size_t re_spans(Regex* re, const char* text, std::vector<uint32_t>* spans) {
+    size_t len = strlen(text), n = 0;
+    std::vector<uint8_t> at(len + 1);      // F_WORD / F_BOL before each offset
+    std::vector<int> cur, set, next;
+    std::vector<uint32_t> cur_from, set_from, next_from;
+    long best_from = -1, best_to = -1;
+    uint8_t flags = F_BOL;
+    for (size_t i = 0;; i++) {
+        if (text[i] == '<') {
+            const char* gt = strchr(text + i, '>');
+            if (gt) { i = gt - text; continue; }
+        }
+        at[i] = flags;
+        unsigned char c = (unsigned char)text[i];
+        bool cont = (c & 0xC0) == 0x80;
+        Ctx x = { (flags & F_WORD) != 0, (flags & F_BOL) != 0, c && (cont ? (flags & F_WORD) != 0 : word_char(c)), c == 0 };
+        // Closure in this context, oldest threads (earliest starts) first
+        re->gen++;
+        set.clear();
+        set_from.clear();
+        for (size_t k = 0; k < cur.size(); k++) {
+            add_pc(re, &set, cur[k], &x);
+            set_from.resize(set.size(), cur_from[k]);
+        }
+        if (best_from < 0 && !cont) {
+            add_pc(re, &set, re->start, &x);
+            set_from.resize(set.size(), i);
+        }
+        next.clear();
+        next_from.clear();
+        for (size_t k = 0; k < set.size(); k++) {
+            const Inst* in = &re->prog[set[k]];
+            if (best_from >= 0 && set_from[k] > best_from) continue;
+            if (in->op == I_MATCH) {
+                if (set_from[k] < i && (best_from < 0 || (long)set_from[k] < best_from || (long)i > best_to)) {
+                    best_from = set_from[k];
+                    best_to = i;
+                }
+            } else if (in->op == I_RANGE && c >= in->lo && c <= in->hi) {
+                next.push_back(in->out);
+                next_from.push_back(set_from[k]);
+            }
+        }
+        if (best_from >= 0) {
+            size_t keep = 0;
+            for (size_t k = 0; k < next.size(); k++)
+                if ((long)next_from[k] <= best_from) { next[keep] = next[k]; next_from[keep++] = next_from[k]; }
+            next.resize(keep);
+            next_from.resize(keep);
+        }
+        if (best_from >= 0 && (next.empty() || !c)) {
+            // Nothing can still match further left or longer: take it and
+            // go on from its end (offsets after it were not tried as starts)
+            spans->push_back(best_from);
+            spans->push_back(best_to);
+            n++;
+            i = best_to;
+            flags = at[i];
+            best_from = best_to = -1;
+            cur.clear();
+            cur_from.clear();
+            i--;
+            continue;
+        }
+        if (!c) break;
+        cur.swap(next);
+        cur_from.swap(next_from);
+        flags = cont ? (flags & F_WORD) : word_char(c) ? F_WORD : 0;
+    }
+    return n;
+}
+
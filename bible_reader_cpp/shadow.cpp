@@ -0,0 +1,108 @@
+// Folded shadow of the verse texts. Every verse is normalized once, the first
+// time a search reaches it, and kept NUL separated in large blocks, so a
+// substring search is one memmem over a block instead of a normalize() per
+// verse and search. The offsets where a 2 byte diacritic became 1 byte are
+// kept per verse to map folded positions back into the original text.
+
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include "corpus_impl.h"
+
+#define SHADOW_BLOCK (1024 * 1024)
+#define SHADOW_BATCH 256    // verses folded per step while scanning
+
+static char* shadow_alloc(Shadow* s, size_t n, uint32_t verse) {
+    if (s->blocks.empty() || s->blocks.back().cap - s->blocks.back().used < n) {
+        ShadowBlock b;
+        b.cap = n > SHADOW_BLOCK ? n : SHADOW_BLOCK;
+        b.data = (char*)malloc(b.cap);
+        b.used = 0;
+        b.first = verse;
+        s->blocks.push_back(b);
+    }
+    return s->blocks.back().data + s->blocks.back().used;
+}
+
+uint32_t shadow_extend(Corpus::Impl* c, uint32_t upto) {
+    Shadow* s = &c->shadow;
+    char buf[MAX_LINE * 2 + 8];
+    if (s->fold_first.empty()) s->fold_first.push_back(0);
+    for (uint32_t i = s->text.size(); i < upto; i++) {
+        ensure_verse(c, i);
+        if (i >= c->nverses) break;
+        const char* text = scan_text(c, i, buf);
+        // Folding never grows the text
+        char* out = shadow_alloc(s, strlen(text) + 1, i);
+        size_t n = normalize_into(text, out, &s->folds);
+        s->blocks.back().used += n + 1;
+        s->text.push_back(out);
+        s->fold_first.push_back(s->folds.size());
+    }
+    return s->text.size();
+}
+
+void shadow_free(Shadow* s) {
+    for (size_t i = 0; i < s->blocks.size(); i++) free(s->blocks[i].data);
+    s->blocks.clear();
+    s->text.clear();
+    s->fold_first.clear();
+    s->folds.clear();
+}
+
+// Block holding verse i, searched from the back since scans move forward
+static const ShadowBlock* block_of(const Shadow* s, uint32_t i) {
+    size_t b = s->blocks.size();
+    while (b > 1 && s->blocks[b - 1].first > i) b--;
+    return &s->blocks[b - 1];
+}
+
+// First verse from i on whose folded text contains q, UINT32_MAX if none
+static uint32_t next_containing(Corpus::Impl* c, const char* q, size_t qlen, uint32_t i) {
+    Shadow* s = &c->shadow;
+    for (;;) {
+        if (i >= s->text.size() && shadow_extend(c, i + SHADOW_BATCH) <= i) return UINT32_MAX;
+        // Matches never cross the NUL between two verses
+        const ShadowBlock* b = block_of(s, i);
+        const char* end = b->data + b->used;
+        const char* m = (const char*)memmem(s->text[i], end - s->text[i], q, qlen);
+        uint32_t last = (b == &s->blocks.back()) ? (uint32_t)s->text.size() : (b + 1)->first;
+        if (!m) {
+            i = last;
+            continue;
+        }
+        // Verse of the hit: the last one starting at or before it
+        return std::upper_bound(s->text.begin() + i, s->text.begin() + last, m) - s->text.begin() - 1;
+    }
+}
+
+size_t shadow_scan(Corpus::Impl* c, bool (*match)(const char* folded, void* arg), void* arg, const char* must,
+                   uint32_t after, uint32_t* ids, size_t cap) {
+    Shadow* s = &c->shadow;
+    size_t mlen = must ? strlen(must) : 0, n = 0;
+    // Until the shadow covers every verse, chapters the filters rule out are
+    // not decoded at all
+    BloomIndex* bi;
+    std::vector<uint32_t> trigrams;
+    if (mlen && !(c->complete && s->text.size() >= c->nverses) && (bi = bloom_index(c)) && blm_trigrams(must, &trigrams))
+        return bloom_scan(c, bi, trigrams, match, arg, must, after, ids, cap);
+    for (uint32_t i = after; n < cap || !ids; i++) {
+        if (mlen) {
+            // Only verses holding the required literal reach the matcher
+            if ((i = next_containing(c, must, mlen, i)) == UINT32_MAX) break;
+        } else if (i >= s->text.size() && shadow_extend(c, i + SHADOW_BATCH) <= i) {
+            break;
+        }
+        if (!match || match(s->text[i], arg)) {
+            if (ids) ids[n] = i;
+            n++;
+        }
+    }
+    return n;
+}
+
+static bool match_word(const char* folded, void* q) { return word_match(folded, (const char*)q); }
+
+size_t shadow_find(Corpus::Impl* c, const char* q, bool whole_word, uint32_t after, uint32_t* ids, size_t cap) {
+    return shadow_scan(c, whole_word ? match_word : NULL, (void*)q, q, after, ids, cap);
+}
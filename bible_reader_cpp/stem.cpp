@@ -0,0 +1,189 @@
+// Light Romanian stemmer and the stem index written by `extractor -stems`
+// (see cmd/extractor/stems.go, which has the same rules). On folded words:
+// one article / case ending, then one plural / verb ending is cut, each
+// only while STEM_MIN bytes are left, so lumina luminii luminile lumineaza
+// all become lumin. With bible_data.stm a --stem search is one posting list
+// per query word; without it the shadow is scanned with the same stemmer.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <iterator>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "corpus_impl.h"
+
+#define STEM_MIN 3
+#define STEM_MAX_WORDS 32
+
+static const char* const stem_case[] = { "urilor", "ilor", "elor", "ului", "lor", "lui", "ul", "le", NULL };
+static const char* const stem_end[] = { "easca", "eaza", "esc", "este", "esti", "eze", "eam", "eau", "ind", "and",
+                                        "ata", "ati", "ate", "ita", "ite", "iti", "uri", "at", "it", "ez", "ii", "ei",
+                                        "ie", "ea", "a", "e", "i", "u", NULL };
+
+static size_t cut_suffix(const char* w, size_t len, const char* const* suffix) {
+    for (; *suffix; suffix++) {
+        size_t n = strlen(*suffix);
+        if (len >= n + STEM_MIN && memcmp(w + len - n, *suffix, n) == 0) return len - n;
+    }
+    return len;
+}
+
+size_t stem_word(const char* w, size_t len) { return cut_suffix(w, cut_suffix(w, len, stem_case), stem_end); }
+
+void query_stems(const char* query_norm, std::vector<std::string>* stems) {
+    uint32_t len;
+    for (const char* w = query_norm; (w = next_word(w, &len)); w += len) {
+        std::string s(w, stem_word(w, len));
+        if (stems->size() < STEM_MAX_WORDS && std::find(stems->begin(), stems->end(), s) == stems->end())
+            stems->push_back(s);
+    }
+}
+
+struct StemIndex {
+    const unsigned char* map;
+    size_t map_len;
+    uint32_t nverses;
+    std::vector<const char*> stems;   // sorted
+    const unsigned char* offsets;     // nstems + 1
+    const unsigned char* data;
+    uint32_t data_len;
+};
+
+StemIndex* stm_open(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < 20) { close(fd); return NULL; }
+    void* m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED) return NULL;
+    StemIndex* si = new StemIndex();
+    si->map = (const unsigned char*)m;
+    si->map_len = st.st_size;
+    const unsigned char* end = si->map + si->map_len;
+    uint32_t nstems = rd32(si->map + 12), names = rd32(si->map + 16);
+    if (memcmp(si->map, "BSTM", 4) != 0 || si->map[4] != 1 || names > si->map_len - 20 ||
+        (si->map_len - 20 - names) / 4 < (size_t)nstems + 1) {
+        stm_close(si);
+        return NULL;
+    }
+    si->nverses = rd32(si->map + 8);
+    const char* p = (const char*)si->map + 20;
+    const char* pend = p + names;
+    while (p < pend && si->stems.size() < nstems) {
+        const char* nul = (const char*)memchr(p, 0, pend - p);
+        if (!nul) break;
+        si->stems.push_back(p);
+        p = nul + 1;
+    }
+    si->offsets = (const unsigned char*)pend;
+    si->data = si->offsets + 4 * ((size_t)nstems + 1);
+    si->data_len = rd32(si->offsets + 4 * nstems);
+    if (si->stems.size() != nstems || si->data_len > (size_t)(end - si->data)) {
+        stm_close(si);
+        return NULL;
+    }
+    return si;
+}
+
+void stm_close(StemIndex* si) {
+    if (!si) return;
+    munmap((void*)si->map, si->map_len);
+    delete si;
+}
+
+uint32_t stm_verses(StemIndex* si) { return si->nverses; }
+
+static bool stem_less(const char* a, const std::string& b) { return strcmp(a, b.c_str()) < 0; }
+
+// Verse indexes of one stem, in order; empty if the text never has it
+static void postings(StemIndex* si, const std::string& s, std::vector<uint32_t>* out) {
+    out->clear();
+    std::vector<const char*>::const_iterator it = std::lower_bound(si->stems.begin(), si->stems.end(), s, stem_less);
+    if (it == si->stems.end() || s != *it) return;
+    size_t k = it - si->stems.begin();
+    uint32_t lo = rd32(si->offsets + 4 * k), hi = rd32(si->offsets + 4 * (k + 1));
+    if (lo > hi || hi > si->data_len) return;
+    const unsigned char* p = si->data + lo;
+    const unsigned char* end = si->data + hi;
+    uint32_t v = 0;
+    while (p < end) {
+        uint32_t gap = 0;
+        for (int shift = 0; p < end && shift < 35; shift += 7) {
+            gap |= (uint32_t)(*p & 0x7F) << shift;
+            if (!(*p++ & 0x80)) break;
+        }
+        v += gap;
+        out->push_back(v);
+    }
+}
+
+bool stems_in(const char* folded, const std::vector<std::string>& stems, std::vector<uint32_t>* spans) {
+    uint64_t found = 0, all = (1ull << stems.size()) - 1;
+    uint32_t len;
+    for (const char* w = folded; (w = next_word(w, &len)); w += len) {
+        size_t sl = stem_word(w, len);
+        for (size_t j = 0; j < stems.size(); j++) {
+            if (stems[j].size() != sl || memcmp(stems[j].data(), w, sl) != 0) continue;
+            found |= 1ull << j;
+            if (spans) {
+                spans->push_back(w - folded);
+                spans->push_back(w - folded + len);
+            }
+            break;
+        }
+        if (found == all && !spans) return true;
+    }
+    return found == all;
+}
+
+static bool match_stems(const char* folded, void* stems) {
+    return stems_in(folded, *(const std::vector<std::string>*)stems, NULL);
+}
+
+static bool by_size(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b) { return a.size() < b.size(); }
+
+size_t stem_find(Corpus::Impl* c, StemIndex* si, const char* query_norm, uint32_t after, uint32_t* ids, size_t cap) {
+    std::vector<std::string> stems;
+    query_stems(query_norm, &stems);
+    if (stems.empty()) return 0;
+
+    if (!si) {
+        // Each stem is a prefix of the words it comes from: the longest one
+        // has to be in the verse
+        size_t longest = 0;
+        for (size_t j = 1; j < stems.size(); j++)
+            if (stems[j].size() > stems[longest].size()) longest = j;
+        return shadow_scan(c, match_stems, &stems, stems[longest].c_str(), after, ids, cap);
+    }
+
+    // Intersect the posting lists, the shortest first
+    std::vector<std::vector<uint32_t> > lists(stems.size());
+    for (size_t j = 0; j < stems.size(); j++) {
+        postings(si, stems[j], &lists[j]);
+        if (lists[j].empty()) return 0;
+    }
+    std::sort(lists.begin(), lists.end(), by_size);
+    std::vector<uint32_t> hits = lists[0], both;
+    for (size_t j = 1; j < lists.size() && !hits.empty(); j++) {
+        both.clear();
+        std::set_intersection(hits.begin(), hits.end(), lists[j].begin(), lists[j].end(), std::back_inserter(both));
+        hits.swap(both);
+    }
+    std::vector<uint32_t>::const_iterator it = std::lower_bound(hits.begin(), hits.end(), after);
+    size_t n = hits.end() - it;
+    if (!ids) return n;
+    n = std::min(n, cap);
+    std::copy(it, it + n, ids);
+    return n;
+}
+
+void stem_spans(const char* folded, const char* query_norm, std::vector<uint32_t>* spans) {
+    std::vector<std::string> stems;
+    query_stems(query_norm, &stems);
+    stems_in(folded, stems, spans);
+}
@@ -0,0 +1,496 @@
+// xz stream source: decoding runs on its own thread, parsing on the caller's.
+// A file made of independent xz blocks (xz -T / --block-size) is decoded by a
+// pool of threads instead, one block per ring slot, handed over in order.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifndef NO_LZMA
+#include <lzma.h>
+#else
+#include <cerrno>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+extern char** environ;
+#endif
+#include "corpus_impl.h"
+
+// Single-producer/single-consumer ring of fixed size chunks.
+// The decoder thread writes straight into a free slot and publishes its length,
+// the parser reads lines in place and releases the slot when it moves on.
+// A side that has to wait spins briefly, then sleeps on a condition variable;
+// the other side only takes the lock to wake it when someone sleeps.
+struct Ring {
+    char path[MAX_LINE];
+    char* data;
+    size_t chunk;
+    unsigned slots;
+    size_t* lens;                   // bytes in each slot, 0 marks end of stream
+    std::atomic<unsigned>* ready;   // per slot: sequence number + 1 once published
+    std::atomic<unsigned> head;     // slots published by the producer
+    std::atomic<unsigned> tail;     // slots released by the consumer
+    std::atomic<bool> stop;         // consumer is done, producer should quit
+    int fd;                         // NO_LZMA: read end of the xz pipe, -1 if none
+    pthread_mutex_t lock;
+    pthread_cond_t freed;           // producers wait here for a free slot
+    pthread_cond_t published;       // the consumer waits here for the next slot
+    std::atomic<int> sleepers;
+};
+
+// Checks before a waiting side goes to sleep
+#define RING_SPINS 1000
+
+// chunk / slots 0: the BIBLE_CHUNK_KB / BIBLE_RING_CHUNKS defaults
+static bool ring_init(Ring* r, size_t chunk, unsigned slots) {
+    const char* kb = getenv("BIBLE_CHUNK_KB");
+    const char* n = getenv("BIBLE_RING_CHUNKS");
+    r->chunk = chunk ? chunk : (size_t)(kb && atoi(kb) >= 16 ? atoi(kb) : CHUNK_KB) * 1024; // >= 4 lines of lookahead
+    r->slots = slots ? slots : n && atoi(n) > 2 ? atoi(n) : RING_CHUNKS;
+    // +1 so the parser can always NUL terminate a last line without newline
+    r->data = (char*)malloc((r->chunk + 1) * r->slots);
+    r->lens = (size_t*)calloc(r->slots, sizeof(size_t));
+    r->ready = new std::atomic<unsigned>[r->slots];
+    for (unsigned i = 0; i < r->slots; i++) r->ready[i].store(0);
+    r->head.store(0); r->tail.store(0); r->stop.store(false);
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->freed, NULL);
+    pthread_cond_init(&r->published, NULL);
+    r->sleepers.store(0);
+    return r->data && r->lens;
+}
+
+static void ring_free(Ring* r) {
+    free(r->data);
+    free(r->lens);
+    delete[] r->ready;
+    pthread_cond_destroy(&r->freed);
+    pthread_cond_destroy(&r->published);
+    pthread_mutex_destroy(&r->lock);
+}
+
+// Slot i may be written (no more than `slots` ahead of the consumer), or the
+// consumer stopped
+static bool slot_free(Ring* r, unsigned i) {
+    return i - r->tail.load(std::memory_order_acquire) < r->slots || r->stop.load(std::memory_order_relaxed);
+}
+
+static bool slot_ready(Ring* r, unsigned i) {
+    return r->ready[i % r->slots].load(std::memory_order_acquire) == i + 1;
+}
+
+// Waits for cond(r, i). The other side is usually about to get there, so
+// spin a little first. The fences pair with ring_signal: either the check
+// here sees its change or it sees a sleeper and wakes it.
+static void ring_wait(Ring* r, pthread_cond_t* cv, bool (*cond)(Ring*, unsigned), unsigned i) {
+    for (int k = 0; k < RING_SPINS; k++)
+        if (cond(r, i)) return;
+    pthread_mutex_lock(&r->lock);
+    r->sleepers.fetch_add(1);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    while (!cond(r, i)) pthread_cond_wait(cv, &r->lock);
+    r->sleepers.fetch_sub(1);
+    pthread_mutex_unlock(&r->lock);
+}
+
+// After a change a waiter may be waiting for
+static void ring_signal(Ring* r, pthread_cond_t* cv) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!r->sleepers.load(std::memory_order_relaxed)) return;
+    pthread_mutex_lock(&r->lock);
+    pthread_cond_broadcast(cv);
+    pthread_mutex_unlock(&r->lock);
+}
+
+static char* slot_ptr(Ring* r, unsigned i) { return r->data + (size_t)(i % r->slots) * (r->chunk + 1); }
+
+// Producer: wait for a free slot. NULL when the consumer stopped.
+static char* ring_write_slot(Ring* r) {
+    unsigned h = r->head.load(std::memory_order_relaxed);
+    ring_wait(r, &r->freed, slot_free, h);
+    if (h - r->tail.load(std::memory_order_acquire) == r->slots) return NULL;
+    return slot_ptr(r, h);
+}
+
+// Slot i is complete; producers may finish slots out of order
+static void ring_publish_at(Ring* r, unsigned i, size_t len) {
+    r->lens[i % r->slots] = len;
+    r->ready[i % r->slots].store(i + 1, std::memory_order_release);
+    ring_signal(r, &r->published);
+}
+
+static void ring_publish(Ring* r, size_t len) {
+    unsigned h = r->head.load(std::memory_order_relaxed);
+    ring_publish_at(r, h, len);
+    r->head.store(h + 1, std::memory_order_relaxed);
+}
+
+// Consumer: wait for the next published slot.
+static char* ring_read_slot(Ring* r, unsigned i, size_t* len) {
+    ring_wait(r, &r->published, slot_ready, i);
+    *len = r->lens[i % r->slots];
+    return slot_ptr(r, i);
+}
+
+static void ring_release(Ring* r) {
+    r->tail.store(r->tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    ring_signal(r, &r->freed);
+}
+
+#ifndef NO_LZMA
+// Decodes the .xz file with liblzma directly into ring slots.
+static void* decode_thread(void* arg) {
+    Ring* r = (Ring*)arg;
+    FILE* in = fopen(r->path, "rb");
+    lzma_stream strm = LZMA_STREAM_INIT;
+    if (!in || lzma_stream_decoder(&strm, UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK) {
+        fprintf(stderr, "Error: could not open %s\n", r->path);
+        if (in) fclose(in);
+        ring_publish(r, 0);
+        return NULL;
+    }
+    const size_t inlen = 64 * 1024;
+    uint8_t* inbuf = (uint8_t*)malloc(inlen);
+    lzma_action action = LZMA_RUN;
+    lzma_ret ret = LZMA_OK;
+    while (ret == LZMA_OK) {
+        char* out = ring_write_slot(r);
+        if (!out) break;
+        strm.next_out = (uint8_t*)out;
+        strm.avail_out = r->chunk;
+        while (strm.avail_out && ret == LZMA_OK) {
+            if (strm.avail_in == 0 && action == LZMA_RUN) {
+                strm.next_in = inbuf;
+                strm.avail_in = fread(inbuf, 1, inlen, in);
+                if (strm.avail_in == 0) action = LZMA_FINISH;
+            }
+            ret = lzma_code(&strm, action);
+        }
+        if (ret != LZMA_OK && ret != LZMA_STREAM_END) fprintf(stderr, "Error: xz decode failed (%d)\n", ret);
+        size_t n = r->chunk - strm.avail_out;
+        if (n) ring_publish(r, n);
+    }
+    if (!r->stop.load()) {
+        // Wait for room for the end marker
+        if (ring_write_slot(r)) ring_publish(r, 0);
+    }
+    lzma_end(&strm);
+    free(inbuf);
+    fclose(in);
+    return NULL;
+}
+
+// Multi-block files: the index at the end of the stream lists every block,
+// so blocks can be decoded independently, one per ring slot. Workers claim
+// blocks in order but may finish out of order; the parser waits on the slot
+// sequence, and no worker gets more than `slots` blocks ahead of it.
+struct XzBlock {
+    uint64_t offset;        // of the block header in the file
+    uint64_t size;          // compressed, header included
+};
+
+struct BlockPool {
+    Ring* r;
+    const uint8_t* file;
+    size_t file_len;
+    lzma_check check;
+    size_t chunk;                   // biggest block, uncompressed
+    std::vector<XzBlock> blocks;
+    std::atomic<unsigned> next;     // next block to claim
+    pthread_t threads[DECODE_MAX_THREADS];
+    int nthreads;
+};
+
+// Decodes in steps so a worker notices the parser stopped mid block
+static bool decode_block(const BlockPool* bp, const XzBlock& b, uint8_t* out, size_t cap, size_t* len) {
+    const uint8_t* in = bp->file + b.offset;
+    lzma_filter filters[LZMA_FILTERS_MAX + 1];
+    lzma_block block;
+    memset(&block, 0, sizeof(block));
+    block.version = 1;
+    block.check = bp->check;
+    block.filters = filters;
+    block.header_size = lzma_block_header_size_decode(in[0]);
+    *len = 0;
+    if (block.header_size > b.size || lzma_block_header_decode(&block, NULL, in) != LZMA_OK) return false;
+    lzma_stream strm = LZMA_STREAM_INIT;
+    lzma_ret ret = lzma_block_decoder(&strm, &block);
+    for (int i = 0; filters[i].id != LZMA_VLI_UNKNOWN; i++) free(filters[i].options);
+    strm.next_in = in + block.header_size;
+    strm.avail_in = b.size - block.header_size;
+    strm.next_out = out;
+    while (ret == LZMA_OK && !bp->r->stop.load(std::memory_order_relaxed)) {
+        strm.avail_out = std::min((size_t)(out + cap - strm.next_out), (size_t)64 * 1024);
+        ret = lzma_code(&strm, LZMA_FINISH);
+    }
+    *len = strm.next_out - out;
+    lzma_end(&strm);
+    return ret == LZMA_STREAM_END;
+}
+
+static void* block_worker(void* arg) {
+    BlockPool* bp = (BlockPool*)arg;
+    Ring* r = bp->r;
+    for (;;) {
+        unsigned b = bp->next.fetch_add(1);
+        if (b > bp->blocks.size()) break;
+        // Bounded lookahead: wait until the parser released slot b - slots
+        ring_wait(r, &r->freed, slot_free, b);
+        if (b - r->tail.load(std::memory_order_acquire) >= r->slots) return NULL;
+        if (b == bp->blocks.size()) { ring_publish_at(r, b, 0); break; }
+        size_t n;
+        if (!decode_block(bp, bp->blocks[b], (uint8_t*)slot_ptr(r, b), r->chunk, &n)) {
+            if (r->stop.load()) break;
+            fprintf(stderr, "Error: xz decode failed (block %u)\n", b);
+            n = 0; // ends the stream early, like a corrupt single block file
+        }
+        ring_publish_at(r, b, n);
+    }
+    return NULL;
+}
+
+// Reads the block list of a single stream .xz. NULL for a file with one block
+// (or anything unusual), which goes through the streaming decoder instead.
+static BlockPool* block_pool_open(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    void* map = fstat(fd, &st) == 0 && st.st_size > 2 * LZMA_STREAM_HEADER_SIZE
+                    ? mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (map == MAP_FAILED) return NULL;
+    const uint8_t* file = (const uint8_t*)map;
+    size_t len = st.st_size;
+
+    lzma_stream_flags head, foot;
+    lzma_index* idx = NULL;
+    uint64_t memlimit = UINT64_MAX;
+    size_t pos;
+    bool ok = lzma_stream_header_decode(&head, file) == LZMA_OK &&
+              lzma_stream_footer_decode(&foot, file + len - LZMA_STREAM_HEADER_SIZE) == LZMA_OK &&
+              lzma_stream_flags_compare(&head, &foot) == LZMA_OK &&
+              foot.backward_size + 2 * LZMA_STREAM_HEADER_SIZE <= len;
+    if (ok) {
+        pos = len - LZMA_STREAM_HEADER_SIZE - foot.backward_size;
+        ok = lzma_index_buffer_decode(&idx, &memlimit, NULL, file, &pos, len - LZMA_STREAM_HEADER_SIZE) == LZMA_OK &&
+             lzma_index_stream_size(idx) == len && lzma_index_block_count(idx) > 1;
+    }
+    BlockPool* bp = NULL;
+    if (ok) {
+        bp = new BlockPool();
+        bp->file = file;
+        bp->file_len = len;
+        bp->check = head.check;
+        lzma_index_iter it;
+        lzma_index_iter_init(&it, idx);
+        while (!lzma_index_iter_next(&it, LZMA_INDEX_ITER_BLOCK)) {
+            if (!it.block.uncompressed_size) continue; // a 0 length slot is the end marker
+            XzBlock b = { it.block.compressed_file_offset, it.block.total_size };
+            bp->blocks.push_back(b);
+            // Lines are glued across slots by the parser, so any block size works
+            if (it.block.uncompressed_size > bp->chunk) bp->chunk = it.block.uncompressed_size;
+        }
+        bp->next.store(0);
+    }
+    if (idx) lzma_index_end(idx, NULL);
+    if (!bp) munmap(map, len);
+    return bp;
+}
+#endif
+
+#ifdef NO_LZMA
+// No liblzma: xz runs as a child of its own (no shell in between) writing
+// into a pipe; returns its pid and the read end in *fd, or -1.
+static pid_t spawn_xz(const char* path, int* fd) {
+    int p[2];
+    if (pipe(p) != 0) return -1;
+    // Only xz's stdout gets the write end, later children inherit neither
+    fcntl(p[0], F_SETFD, FD_CLOEXEC);
+    fcntl(p[1], F_SETFD, FD_CLOEXEC);
+    posix_spawn_file_actions_t fa;
+    posix_spawn_file_actions_init(&fa);
+    posix_spawn_file_actions_adddup2(&fa, p[1], STDOUT_FILENO);
+    char* argv[] = { (char*)"xz", (char*)"-d", (char*)"-c", (char*)"-T0", (char*)"--", (char*)path, NULL };
+    pid_t pid;
+    int err = posix_spawnp(&pid, "xz", &fa, NULL, argv, environ);
+    posix_spawn_file_actions_destroy(&fa);
+    close(p[1]);
+    if (err) {
+        fprintf(stderr, "Error: could not run xz: %s\n", strerror(err));
+        close(p[0]);
+        return -1;
+    }
+    *fd = p[0];
+    return pid;
+}
+
+// The thread pumps the pipe into ring slots
+static void* decode_thread(void* arg) {
+    Ring* r = (Ring*)arg;
+    for (;;) {
+        char* out = r->fd >= 0 ? ring_write_slot(r) : NULL;
+        if (!out) break;
+        size_t n = 0;
+        while (n < r->chunk) {
+            ssize_t k = read(r->fd, out + n, r->chunk - n);
+            if (k < 0 && errno == EINTR) continue;
+            if (k <= 0) break;
+            n += k;
+        }
+        ring_publish(r, n);
+        if (n == 0) return NULL;
+    }
+    if (r->fd < 0) ring_publish(r, 0);
+    return NULL;
+}
+#endif
+
+// Splits ring chunks into NUL terminated lines without copying them.
+// A line cut by a chunk boundary is glued together in `carry` (two of them,
+// used in turn). The last two slots entered are held: entering a slot
+// releases the one before the previous, so the previous line stays valid
+// while the next one is read, even when that one crosses into a new slot.
+// The ring needs at least 3 slots for that.
+struct LineReader {
+    Ring* r;
+    unsigned slot;      // next slot to enter
+    unsigned held;      // slots entered and not released yet, at most 2
+    char* p;
+    char* end;
+    bool eof;
+    char carry[2][MAX_LINE];
+    int carry_idx;
+};
+
+static bool enter_slot(LineReader* lr) {
+    if (lr->held == 2) ring_release(lr->r);
+    else lr->held++;
+    size_t len;
+    char* data = ring_read_slot(lr->r, lr->slot, &len);
+    lr->slot++;
+    if (len == 0) { lr->eof = true; return false; }
+    lr->p = data;
+    lr->end = data + len;
+    return true;
+}
+
+static char* next_line(LineReader* lr) {
+    if (lr->eof) return NULL;
+    if (lr->p == lr->end && !enter_slot(lr)) return NULL;
+
+    char* nl = (char*)memchr(lr->p, '\n', lr->end - lr->p);
+    if (nl) {
+        char* line = lr->p;
+        *nl = 0;
+        lr->p = nl + 1;
+        return line;
+    }
+    // Line continues in the next chunk(s)
+    char* buf = lr->carry[lr->carry_idx ^= 1];
+    size_t n = 0;
+    for (;;) {
+        size_t take = lr->end - lr->p;
+        nl = (char*)memchr(lr->p, '\n', take);
+        if (nl) take = nl - lr->p;
+        if (n + take >= MAX_LINE) take = MAX_LINE - 1 - n;
+        memcpy(buf + n, lr->p, take);
+        n += take;
+        if (nl) { lr->p = nl + 1; break; }
+        lr->p = lr->end;
+        if (!enter_slot(lr)) break;
+    }
+    buf[n] = 0;
+    if (n == 0 && lr->eof) return NULL;
+    return buf;
+}
+
+struct XzStream {
+    Ring ring;
+    pthread_t decoder;
+#ifndef NO_LZMA
+    BlockPool* pool;    // multi-block file, NULL for the streaming decoder
+#else
+    pid_t child;        // xz, -1 if it could not be started
+#endif
+    LineReader lr;
+};
+
+#ifndef NO_LZMA
+static int env_int(const char* name, int def) {
+    const char* v = getenv(name);
+    return v && atoi(v) > 0 ? atoi(v) : def;
+}
+#endif
+
+XzStream* xz_open(const char* path) {
+    XzStream* xs = new XzStream;
+    memset(&xs->lr, 0, sizeof(xs->lr));
+    xs->lr.r = &xs->ring;
+    snprintf(xs->ring.path, sizeof(xs->ring.path), "%s", path);
+#ifndef NO_LZMA
+    xs->pool = block_pool_open(path);
+    if (xs->pool) {
+        BlockPool* bp = xs->pool;
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        bp->nthreads = std::min(env_int("BIBLE_DECODE_THREADS", cores > 0 ? (int)cores : 1), DECODE_MAX_THREADS);
+        bp->nthreads = std::min(bp->nthreads, (int)bp->blocks.size());
+        // One block per worker plus the two the parser holds keeps every core busy
+        unsigned slots = std::max(3, env_int("BIBLE_BLOCKS_IN_FLIGHT", bp->nthreads + 2));
+        if (!ring_init(&xs->ring, bp->chunk, slots)) {
+            ring_free(&xs->ring);
+            munmap((void*)bp->file, bp->file_len);
+            delete bp;
+            delete xs;
+            return NULL;
+        }
+        bp->r = &xs->ring;
+        for (int t = 0; t < bp->nthreads; t++) pthread_create(&bp->threads[t], NULL, block_worker, bp);
+        return xs;
+    }
+#endif
+    if (!ring_init(&xs->ring, 0, 0)) {
+        ring_free(&xs->ring);
+        delete xs;
+        return NULL;
+    }
+#ifdef NO_LZMA
+    xs->ring.fd = -1;
+    xs->child = spawn_xz(path, &xs->ring.fd);
+#endif
+    pthread_create(&xs->decoder, NULL, decode_thread, &xs->ring);
+    return xs;
+}
+
+char* xz_line(XzStream* xs) { return next_line(&xs->lr); }
+
+void xz_close(XzStream* xs) {
+    // Stop the decoder right away, it may be blocked on a full ring
+    xs->ring.stop.store(true);
+    ring_signal(&xs->ring, &xs->ring.freed);
+#ifdef NO_LZMA
+    // xz would go on decoding into a pipe nobody reads: end it now, so the
+    // thread sees the end of the pipe, and reap it below
+    if (xs->child > 0) kill(xs->child, SIGTERM);
+#else
+    if (BlockPool* bp = xs->pool) {
+        for (int t = 0; t < bp->nthreads; t++) pthread_join(bp->threads[t], NULL);
+        munmap((void*)bp->file, bp->file_len);
+        delete bp;
+    } else
+#endif
+    pthread_join(xs->decoder, NULL);
+#ifdef NO_LZMA
+    if (xs->ring.fd >= 0) close(xs->ring.fd);
+    while (xs->child > 0 && waitpid(xs->child, NULL, 0) < 0 && errno == EINTR) {}
+#endif
+    ring_free(&xs->ring);
+    delete xs;
+}
@@ -0,0 +1,100 @@
+// Table of contents written by `extractor -toc` (see cmd/extractor/toc.go):
+// books, verses per chapter and every section title with the verse it
+// starts at. The file is mapped and walked once at open; nothing in it
+// needs the decoder, so list / toc / title searches never start xz.
+
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "corpus_impl.h"
+
+struct Toc {
+    const unsigned char* map;
+    size_t map_len;
+    int nbooks;
+    const char* book_name[256];
+    uint32_t first_chapter[257];        // global chapter index, +1 sentinel
+    std::vector<uint32_t> chapter_first; // first verse of every chapter, +1 sentinel
+    std::vector<SectionTitle> titles;
+};
+
+Toc* toc_open(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < 9) { close(fd); return NULL; }
+    void* m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED) return NULL;
+    Toc* t = new Toc();
+    t->map = (const unsigned char*)m;
+    t->map_len = st.st_size;
+    if (memcmp(t->map, "BTOC", 4) != 0 || t->map[4] != 1) { toc_close(t); return NULL; }
+
+    // Every read below stays inside the map, a truncated file is refused
+    const unsigned char* p = t->map + 8;
+    const unsigned char* end = t->map + t->map_len;
+    std::vector<VerseRef> chapter_ref;  // book and chapter of every chapter
+    uint32_t verse = 0;
+    t->nbooks = *p++;
+    for (int b = 0; b < t->nbooks; b++) {
+        const unsigned char* nul = (const unsigned char*)memchr(p, 0, end - p);
+        if (!nul || end - nul < 2 || end - nul - 2 < nul[1]) { toc_close(t); return NULL; }
+        t->book_name[b] = (const char*)p;
+        p = nul + 1;
+        int nchapters = *p++;
+        t->first_chapter[b] = t->chapter_first.size();
+        for (int c = 0; c < nchapters; c++) {
+            t->chapter_first.push_back(verse);
+            chapter_ref.push_back(VerseRef::make(b + 1, c + 1, 0));
+            verse += *p++;
+        }
+    }
+    t->first_chapter[t->nbooks] = t->chapter_first.size();
+    t->chapter_first.push_back(verse);
+    if (end - p < 8 || rd32(p) != verse) { toc_close(t); return NULL; }
+    uint32_t ntitles = rd32(p + 4);
+    p += 8;
+
+    size_t g = 0;
+    for (uint32_t i = 0; i < ntitles; i++) {
+        const unsigned char* nul = end - p >= 4 ? (const unsigned char*)memchr(p + 4, 0, end - p - 4) : NULL;
+        uint32_t index = nul ? rd32(p) : verse;
+        if (index >= verse) { toc_close(t); return NULL; }
+        while (t->chapter_first[g + 1] <= index) g++;
+        SectionTitle s;
+        s.index = index;
+        s.ref = VerseRef::make(chapter_ref[g].book(), chapter_ref[g].chapter(), index - t->chapter_first[g] + 1);
+        s.title = (const char*)p + 4;
+        t->titles.push_back(s);
+        p = nul + 1;
+    }
+    return t;
+}
+
+void toc_close(Toc* t) {
+    if (!t) return;
+    munmap((void*)t->map, t->map_len);
+    delete t;
+}
+
+int toc_books(Toc* t) { return t->nbooks; }
+
+const char* toc_book_name(Toc* t, int book) { return book >= 1 && book <= t->nbooks ? t->book_name[book - 1] : NULL; }
+
+int toc_chapters(Toc* t, int book) {
+    return book >= 1 && book <= t->nbooks ? (int)(t->first_chapter[book] - t->first_chapter[book - 1]) : 0;
+}
+
+bool toc_chapter(Toc* t, int book, int chapter, uint32_t* first, uint32_t* count) {
+    if (chapter < 1 || chapter > toc_chapters(t, book)) return false;
+    size_t g = t->first_chapter[book - 1] + chapter - 1;
+    *first = t->chapter_first[g];
+    *count = t->chapter_first[g + 1] - t->chapter_first[g];
+    return true;
+}
+
+const std::vector<SectionTitle>& toc_titles(Toc* t) { return t->titles; }
@@ -0,0 +1,347 @@
+// Word-token corpus written by `extractor -tokens` (see cmd/extractor/tokens.go):
+// canonical Huffman codes over word/separator token IDs. A search for whole
+// words walks the IDs and never rebuilds text, only hits are decoded.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include "corpus_impl.h"
+
+#ifndef NO_LZMA
+#include <lzma.h>
+
+#define TOK_LOOKUP 11
+#define TOK_MAXLEN 24
+
+enum { TK_WORD = 1, TK_NL = 2, TK_BOOK = 4, TK_CHAP = 8, TK_T = 16, TK_R = 32 };
+
+struct TokCorpus {
+    unsigned char* file;
+    int max_len;
+    uint32_t count[TOK_MAXLEN + 1], first[TOK_MAXLEN + 1], offset[TOK_MAXLEN + 1];
+    uint32_t nsym;
+    char* vocab;
+    const char** sym;
+    uint8_t* flags;
+    int* num;             // value of all-digit words, else -1
+    uint32_t* lookup;     // (sym << 5) | len for codes up to TOK_LOOKUP bits
+    const unsigned char* stream;
+    size_t stream_len;
+    uint32_t ntokens;
+};
+
+struct BitReader {
+    const unsigned char* start;
+    const unsigned char* p;
+    const unsigned char* end;
+    uint64_t buf;   // left aligned
+    int n;
+};
+
+static inline void br_fill(BitReader* b) {
+    while (b->n <= 56) {
+        b->buf |= (uint64_t)(b->p < b->end ? *b->p : 0) << (56 - b->n);
+        b->p++;
+        b->n += 8;
+    }
+}
+
+static void br_seek(BitReader* b, const TokCorpus* t, uint64_t bit) {
+    b->start = t->stream;
+    b->end = t->stream + t->stream_len;
+    b->p = t->stream + bit / 8;
+    b->buf = 0; b->n = 0;
+    br_fill(b);
+    b->buf <<= bit % 8; b->n -= bit % 8;
+}
+
+static inline uint64_t br_pos(const BitReader* b) { return (uint64_t)(b->p - b->start) * 8 - b->n; }
+
+static inline uint32_t tok_next(const TokCorpus* t, BitReader* b) {
+    if (b->n < 32) br_fill(b);
+    uint32_t e = t->lookup[b->buf >> (64 - TOK_LOOKUP)];
+    if (e) {
+        b->buf <<= e & 31; b->n -= e & 31;
+        return e >> 5;
+    }
+    for (int len = TOK_LOOKUP + 1; len <= t->max_len; len++) {
+        uint32_t code = (uint32_t)(b->buf >> (64 - len));
+        if (code - t->first[len] < t->count[len]) {
+            b->buf <<= len; b->n -= len;
+            return t->offset[len] + code - t->first[len];
+        }
+    }
+    return 0; // corrupt stream
+}
+
+// Every length in the file is checked against its size: a truncated or
+// damaged file is refused and the reader uses the xz stream instead
+static bool tok_load(TokCorpus* t, const char* path) {
+    memset(t, 0, sizeof(*t));
+    FILE* f = fopen(path, "rb");
+    if (!f) return false;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    t->file = size >= 8 ? (unsigned char*)malloc(size) : NULL;
+    if (!t->file || fread(t->file, 1, size, f) != (size_t)size || memcmp(t->file, "BTOK\1", 5) != 0) {
+        fclose(f);
+        return false;
+    }
+    fclose(f);
+
+    const unsigned char* p = t->file + 8;
+    const unsigned char* end = t->file + size;
+    t->max_len = t->file[5];
+    if (t->max_len > TOK_MAXLEN || end - p < 4 * t->max_len + 12) return false;
+    // Canonical code: no length may have more codes than it has room for
+    uint64_t code = 0;
+    uint32_t index = 0;
+    memset(t->count, 0, sizeof(t->count));
+    for (int len = 1; len <= t->max_len; len++) {
+        t->count[len] = rd32(p); p += 4;
+        if (code + t->count[len] > (1ull << len)) return false;
+        t->first[len] = (uint32_t)code;
+        t->offset[len] = index;
+        index += t->count[len];
+        code = (code + t->count[len]) << 1;
+    }
+    t->nsym = rd32(p);
+    size_t raw_len = rd32(p + 4), xz_len = rd32(p + 8);
+    p += 12;
+    if (!t->nsym || index != t->nsym || !raw_len || (size_t)(end - p) < xz_len) return false;
+    t->vocab = (char*)malloc(raw_len);
+    uint64_t memlimit = UINT64_MAX;
+    size_t in_pos = 0, out_pos = 0;
+    if (!t->vocab || lzma_stream_buffer_decode(&memlimit, 0, NULL, p, &in_pos, xz_len, (uint8_t*)t->vocab, &out_pos, raw_len) != LZMA_OK ||
+        out_pos != raw_len || t->vocab[raw_len - 1] != 0)
+        return false;
+    p += xz_len;
+    if (end - p < 8) return false;
+    t->ntokens = rd32(p);
+    t->stream_len = rd32(p + 4);
+    t->stream = p + 8;
+    // Every token takes at least one bit
+    if ((size_t)(end - t->stream) < t->stream_len || t->ntokens / 8 > t->stream_len) return false;
+
+    t->sym = (const char**)malloc(t->nsym * sizeof(char*));
+    t->flags = (uint8_t*)calloc(t->nsym, 1);
+    t->num = (int*)malloc(t->nsym * sizeof(int));
+    const char* v = t->vocab;
+    for (uint32_t i = 0; i < t->nsym; i++) {
+        if (v == t->vocab + raw_len) return false; // fewer strings than symbols
+        const char* s = t->sym[i] = v;
+        size_t len = strlen(s);
+        v += len + 1;
+        t->num[i] = -1;
+        if (is_word_byte((unsigned char)s[0]) && (unsigned char)s[0] != 0xE2) {
+            t->flags[i] = TK_WORD;
+            if (isdigit((unsigned char)s[0]) && strspn(s, "0123456789") == len) t->num[i] = atoi(s);
+            if (strcmp(s, "T") == 0) t->flags[i] |= TK_T;
+            if (strcmp(s, "R") == 0) t->flags[i] |= TK_R;
+        } else if (const char* nl = strrchr(s, '\n')) {
+            t->flags[i] = TK_NL;
+            if (strcmp(nl + 1, "# ") == 0) t->flags[i] |= TK_BOOK;
+            if (strcmp(nl + 1, "= ") == 0) t->flags[i] |= TK_CHAP;
+        }
+    }
+
+    t->lookup = (uint32_t*)calloc(1u << TOK_LOOKUP, sizeof(uint32_t));
+    for (int len = 1; len <= t->max_len && len <= TOK_LOOKUP; len++) {
+        for (uint32_t c = 0; c < t->count[len]; c++) {
+            uint32_t base = (t->first[len] + c) << (TOK_LOOKUP - len);
+            for (uint32_t k = 0; k < (1u << (TOK_LOOKUP - len)); k++)
+                t->lookup[base + k] = ((t->offset[len] + c) << 5) | len;
+        }
+    }
+    return true;
+}
+
+// Decodes the line starting at `bit` into out (without the newline)
+static void tok_line(const TokCorpus* t, uint64_t bit, char* out, size_t cap) {
+    BitReader b;
+    br_seek(&b, t, bit);
+    size_t n = 0;
+    bool prev_word = false;
+    for (;;) {
+        uint32_t id = tok_next(t, &b);
+        const char* s = t->sym[id];
+        size_t len = strlen(s);
+        bool word = t->flags[id] & TK_WORD;
+        if (t->flags[id] & TK_NL) len = strchr(s, '\n') - s;
+        if (word && prev_word && n + 1 < cap) out[n++] = ' ';
+        if (n + len >= cap) len = cap - 1 - n;
+        memcpy(out + n, s, len);
+        n += len;
+        if (t->flags[id] & TK_NL) break;
+        if (br_pos(&b) >= 8 * (uint64_t)t->stream_len) break; // damaged stream, no newline
+        prev_word = word;
+    }
+    out[n] = 0;
+}
+
+TokCorpus* tok_open(const char* path) {
+    TokCorpus* t = (TokCorpus*)malloc(sizeof(TokCorpus));
+    if (!tok_load(t, path)) {
+        tok_close(t);
+        return NULL;
+    }
+    return t;
+}
+
+void tok_close(TokCorpus* t) {
+    if (!t) return;
+    free(t->file);
+    free(t->vocab);
+    free(t->sym);
+    free(t->flags);
+    free(t->num);
+    free(t->lookup);
+    free(t);
+}
+
+// Line structure: a separator holding '\n' ends a line and tells what the
+// next one is ("# " book, "= " chapter, otherwise the first word decides:
+// a number starts a verse, T a title, R the refs of the previous verse).
+enum { L_OTHER, L_START, L_BOOK, L_CHAP, L_VERSE };
+
+void tok_index(TokCorpus* t, Corpus::Impl* c, std::vector<TokVerse>* out) {
+    int state = L_OTHER, book = 0, chapter = 0;
+    uint64_t line_start = 0, title_bit = UINT64_MAX;
+    char name[MAX_LINE];
+
+    BitReader b;
+    br_seek(&b, t, 0);
+    for (uint32_t k = 0; k < t->ntokens; k++) {
+        uint32_t id = tok_next(t, &b);
+        uint8_t fl = t->flags[id];
+        if (!(fl & TK_WORD)) {
+            if (!(fl & TK_NL)) continue;
+            line_start = br_pos(&b);
+            state = (fl & TK_CHAP) ? L_CHAP : (fl & TK_BOOK) ? L_BOOK : L_START;
+            if (fl & (TK_CHAP | TK_BOOK)) title_bit = UINT64_MAX;
+            if (state == L_BOOK) {
+                tok_line(t, line_start, name, sizeof(name));
+                add_book(c, name, strlen(name));
+                book++;
+                chapter = 0;
+                state = L_OTHER;
+            }
+            continue;
+        }
+        if (state == L_CHAP) {
+            chapter = t->num[id];
+            add_chapter(c);
+            state = L_OTHER;
+        } else if (state == L_START) {
+            if (t->num[id] >= 0) {
+                add_verse(c, VerseRef::make(book, chapter, t->num[id]));
+                TokVerse tv = { title_bit, line_start, UINT64_MAX };
+                out->push_back(tv);
+                title_bit = UINT64_MAX;
+            } else if (fl & TK_T) {
+                title_bit = line_start;
+            } else if ((fl & TK_R) && !out->empty()) {
+                out->back().refs_bit = line_start;
+            }
+            state = L_OTHER;
+        }
+    }
+}
+
+void tok_materialize(TokCorpus* t, const TokVerse* tv, Verse* v, Arena* a) {
+    char line[MAX_LINE];
+    v->title = "";
+    v->refs = "";
+    if (tv->title_bit != UINT64_MAX) {
+        tok_line(t, tv->title_bit, line, sizeof(line));
+        if (line[1]) v->title = arena_dup(a, line + 2, strlen(line + 2));
+    }
+    if (tv->refs_bit != UINT64_MAX) {
+        tok_line(t, tv->refs_bit, line, sizeof(line));
+        if (line[1]) v->refs = arena_dup(a, line + 2, strlen(line + 2));
+    }
+    tok_line(t, tv->verse_bit, line, sizeof(line));
+    const char* sp = strchr(line, ' ');
+    sp = sp ? sp + 1 : line + strlen(line);
+    v->text = arena_dup(a, sp, strlen(sp));
+}
+
+const char* tok_text(TokCorpus* t, const TokVerse* tv, char* buf) {
+    tok_line(t, tv->verse_bit, buf, MAX_LINE);
+    const char* sp = strchr(buf, ' ');
+    return sp ? sp + 1 : buf + strlen(buf);
+}
+
+// Query words must follow each other with an implicit single space, like a
+// phrase in the text.
+size_t tok_find(TokCorpus* t, const char* query_norm, uint32_t after, uint32_t* ids, size_t cap) {
+    char q[MAX_LINE];
+    snprintf(q, sizeof(q), "%s", query_norm);
+    const char* words[32];
+    int nwords = 0;
+    for (char* w = strtok(q, " "); w && nwords < 32; w = strtok(NULL, " ")) words[nwords++] = w;
+    if (nwords == 0) return 0;
+
+    // Bit j set in mask[id] when token id folds to query word j
+    uint32_t* mask = (uint32_t*)calloc(t->nsym, sizeof(uint32_t));
+    char norm[MAX_LINE * 2];
+    for (uint32_t i = 0; i < t->nsym; i++) {
+        if (!(t->flags[i] & TK_WORD)) continue;
+        normalize_into(t->sym[i], norm);
+        for (int j = 0; j < nwords; j++)
+            if (strcmp(norm, words[j]) == 0) mask[i] |= 1u << j;
+    }
+    const uint32_t done = 1u << (nwords - 1);
+
+    int state = L_OTHER;
+    uint32_t verse = 0; // index of the next verse
+    uint32_t partial = 0;
+    bool matched = true;
+    size_t n = 0;
+
+    BitReader b;
+    br_seek(&b, t, 0);
+    for (uint32_t k = 0; k < t->ntokens; k++) {
+        uint32_t id = tok_next(t, &b);
+        uint8_t fl = t->flags[id];
+        if (!(fl & TK_WORD)) {
+            partial = 0;
+            if (fl & TK_NL) state = (fl & (TK_CHAP | TK_BOOK)) ? L_OTHER : L_START;
+            continue;
+        }
+        if (state == L_START) {
+            if (t->num[id] >= 0) {
+                state = L_VERSE;
+                matched = verse++ < after; // skip verses before the cursor
+            } else {
+                state = L_OTHER;
+            }
+            continue;
+        }
+        if (state != L_VERSE || matched) continue;
+        partial = ((partial << 1) | 1) & mask[id];
+        if (partial & done) {
+            matched = true;
+            if (ids) {
+                if (n == cap) break;
+                ids[n] = verse - 1;
+            }
+            n++;
+        }
+    }
+    free(mask);
+    return n;
+}
+
+#else
+
+TokCorpus* tok_open(const char*) { return NULL; }
+void tok_close(TokCorpus*) {}
+void tok_index(TokCorpus*, Corpus::Impl*, std::vector<TokVerse>*) {}
+void tok_materialize(TokCorpus*, const TokVerse*, Verse*, Arena*) {}
+const char* tok_text(TokCorpus*, const TokVerse*, char*) { return ""; }
+size_t tok_find(TokCorpus*, const char*, uint32_t, uint32_t*, size_t) { return 0; }
+
+#endif
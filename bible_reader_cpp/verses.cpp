@@ -0,0 +1,161 @@
+// Per-verse store written by `extractor -verses` (see cmd/extractor/verses.go).
+// Each record "title \x1f text \x1f refs" is FSST coded on its own with one
+// shared table of up to 255 symbols (<= 8 bytes, code 255 escapes a byte),
+// and an offset per verse makes any verse decodable in isolation. The file
+// is mapped, so a `read` only touches the pages of the verses it prints.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "corpus_impl.h"
+
+#define VRS_ESCAPE 255
+// Decoded record bytes, so a damaged record still fits every caller's buffer
+#define VRS_MAX_OUT (MAX_LINE * 2 - 16)
+
+struct VerseStore {
+    const unsigned char* map;
+    size_t map_len;
+    uint8_t sym_len[256];
+    uint64_t sym[256];          // symbol bytes, always copied as 8 bytes
+    int nbooks;
+    const char* book_name[256];
+    const unsigned char* chapters[256]; // verse count per chapter
+    int nchapters[256];
+    uint32_t nverses;
+    const unsigned char* offsets;
+    const unsigned char* canon; // version 2: canonical ID per verse
+    const unsigned char* data;
+};
+
+VerseStore* vs_open(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < 8) { close(fd); return NULL; }
+    void* m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED) return NULL;
+    VerseStore* vs = (VerseStore*)calloc(1, sizeof(VerseStore));
+    vs->map = (const unsigned char*)m;
+    vs->map_len = st.st_size;
+    int version = vs->map[4];
+    if (memcmp(vs->map, "BVRS", 4) != 0 || version < 1 || version > 2) { vs_close(vs); return NULL; }
+
+    // Every read below stays inside the map, a truncated file is refused
+    // and the reader goes back to the xz stream
+    int nsym = vs->map[5];
+    const unsigned char* p = vs->map + 8;
+    const unsigned char* end = vs->map + vs->map_len;
+    if ((size_t)(end - p) < 9 * (size_t)nsym + 1) { vs_close(vs); return NULL; }
+    for (int i = 0; i < nsym; i++, p += 9) {
+        vs->sym_len[i] = p[0];
+        if (p[0] > 8) { vs_close(vs); return NULL; }
+        memcpy(&vs->sym[i], p + 1, 8);
+    }
+    vs->nbooks = *p++;
+    uint32_t verse = 0;
+    for (int b = 0; b < vs->nbooks; b++) {
+        const unsigned char* nul = (const unsigned char*)memchr(p, 0, end - p);
+        if (!nul || end - nul < 2 || end - nul - 2 < nul[1]) { vs_close(vs); return NULL; }
+        vs->book_name[b] = (const char*)p;
+        p = nul + 1;
+        vs->nchapters[b] = *p++;
+        vs->chapters[b] = p;
+        for (int c = 0; c < vs->nchapters[b]; c++) verse += *p++;
+    }
+    if (end - p < 4 || rd32(p) != verse) { vs_close(vs); return NULL; }
+    vs->nverses = verse;
+    p += 4;
+    // Offsets (and canonical IDs), then as much data as the last offset says
+    size_t tables = (version == 2 ? 8 : 4) * (size_t)verse + 4;
+    if ((size_t)(end - p) < tables) { vs_close(vs); return NULL; }
+    vs->offsets = p;
+    vs->data = p + 4 * ((size_t)verse + 1);
+    if (version == 2) {
+        vs->canon = vs->data;
+        vs->data += 4 * (size_t)verse;
+    }
+    for (uint32_t i = 0; i < verse; i++) {
+        if (rd32(vs->offsets + 4 * i) > rd32(vs->offsets + 4 * (i + 1))) { vs_close(vs); return NULL; }
+    }
+    if ((size_t)(end - vs->data) < rd32(vs->offsets + 4 * (size_t)verse)) { vs_close(vs); return NULL; }
+    return vs;
+}
+
+void vs_close(VerseStore* vs) {
+    if (!vs) return;
+    munmap((void*)vs->map, vs->map_len);
+    free(vs);
+}
+
+// The counts in the header are the whole structure, no record is decoded
+void vs_index(VerseStore* vs, Corpus::Impl* c) {
+    for (int b = 0; b < vs->nbooks; b++) {
+        add_book(c, vs->book_name[b], strlen(vs->book_name[b]));
+        for (int ch = 0; ch < vs->nchapters[b]; ch++) {
+            add_chapter(c);
+            for (int v = 0; v < vs->chapters[b][ch]; v++) add_verse(c, VerseRef::make(b + 1, ch + 1, v + 1));
+        }
+    }
+}
+
+const unsigned char* vs_canon(VerseStore* vs) { return vs->canon; }
+
+// Decodes verse i into out; returns its length. out needs 8 bytes of slack.
+static size_t vs_decode(const VerseStore* vs, uint32_t i, char* out) {
+    const unsigned char* p = vs->data + rd32(vs->offsets + 4 * i);
+    const unsigned char* end = vs->data + rd32(vs->offsets + 4 * (i + 1));
+    char* o = out;
+    while (p < end && o - out < VRS_MAX_OUT) {
+        unsigned c = *p++;
+        if (c == VRS_ESCAPE) {
+            if (p < end) *o++ = *p++;
+            continue;
+        }
+        memcpy(o, &vs->sym[c], 8);
+        o += vs->sym_len[c];
+    }
+    *o = 0;
+    return o - out;
+}
+
+// Splits a decoded record into title / text / refs in place. A record
+// without both separators (a damaged file) is all text.
+static void vs_split(char* rec, char** title, char** text, char** refs) {
+    *title = rec;
+    char* a = strchr(rec, '\x1f');
+    if (!a || !strchr(a + 1, '\x1f')) {
+        *title = *refs = rec + strlen(rec);
+        *text = rec;
+        return;
+    }
+    *a = 0;
+    *text = a + 1;
+    char* b = strchr(a + 1, '\x1f');
+    *b = 0;
+    *refs = b + 1;
+}
+
+void vs_materialize(VerseStore* vs, uint32_t index, Verse* v, Arena* a) {
+    char rec[MAX_LINE * 2 + 8];
+    char *title, *text, *refs;
+    size_t n = vs_decode(vs, index, rec);
+    vs_split(rec, &title, &text, &refs);
+    // One copy of the whole record, the fields keep pointing into it
+    char* copy = arena_dup(a, rec, n);
+    v->title = title[0] ? copy : "";
+    v->text = copy + (text - rec);
+    v->refs = refs[0] ? copy + (refs - rec) : "";
+}
+
+const char* vs_text(VerseStore* vs, uint32_t index, char* buf) {
+    char *title, *text, *refs;
+    vs_decode(vs, index, buf);
+    vs_split(buf, &title, &text, &refs);
+    return text;
+}
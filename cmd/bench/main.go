@@ -0,0 +1,481 @@
+//go:build linux
+
+package main
+
+// Differential benchmark for the language readers.
+//
+// Every reader found (prebuilt, not built here) runs the same workload of
+// read / search / list queries. Its stdout is compared with the C++
+// reader's once the known format differences are normalized away (see
+// normalize), and it is timed cold (binary, data file and xz evicted
+// from the page cache first) and warm (median of -runs). Peak RSS comes
+// from wait4, which includes the xz child; syscalls are counted with
+// ptrace across every process and thread the reader starts. Run from the
+// repository root:
+//
+//	go run cmd/bench/main.go                        # all readers that run here
+//	go run cmd/bench/main.go -markdown              # table for the README
+//	go run cmd/bench/main.go -reader mine=path/to/main_linux -only mine
+
+import (
+	"bytes"
+	"errors"
+	"flag"
+	"fmt"
+	"os"
+	"os/exec"
+	"path/filepath"
+	"regexp"
+	"runtime"
+	"sort"
+	"strings"
+	"syscall"
+	"time"
+)
+
+// Reader is one prebuilt binary; it finds the data as ../bible_data.txt.xz.
+type Reader struct {
+	Name string
+	Path string
+}
+
+// Linux builds as named by the README build steps (and the checked in ones).
+// Readers whose binary is missing or cannot run here are listed as skipped.
+var readers = []Reader{
+	{"C++", "bible_reader_cpp/main_linux"},
+	{"C", "bible_reader_c/main_linux"},
+	{"C (nostart)", "bible_reader_c_nostart/main_linux"},
+	{"Fortran (opt)", "bible_reader_fortran_opt/main_linux"},
+	{"Fortran", "bible_reader_fortran/main_linux"},
+	{"Rust (opt)", "bible_reader_rust_opt/main_linux"},
+	{"Rust", "bible_reader_rust/main_linux"},
+	{"Zig (opt)", "bible_reader_zig_opt/main_linux"},
+	{"Zig", "bible_reader_zig/main_linux_small"},
+	{"Odin", "bible_reader_odin/main_linux"},
+	{"Go (opt)", "bible_reader_go_opt/main_linux"},
+	{"Go", "bible_reader_go/main_linux"},
+	{"Pascal (opt)", "bible_reader_pascal_opt/main_linux"},
+	{"Pascal", "bible_reader_pascal/main_linux"},
+	{"Forth", "bible_reader_forth/main_linux"},
+}
+
+// The workload sticks to what every reader implements: lookups near the
+// start and at the very end of the stream, a capped search, full scans
+// with one hit and none, and the book list.
+var workload = [][]string{
+	{"read", "Ioan", "3", "16"},
+	{"read", "Geneza", "1"},
+	{"read", "Psalmii", "23"},
+	{"read", "Apocalipsa", "22", "21"},
+	{"search", "lumina"},
+	{"search", "Melhisedec"},
+	{"search", "xyzzy"},
+	{"list"},
+}
+
+// Full scan used for throughput: no hit, so every verse is decoded and matched
+var scanQuery = []string{"search", "xyzzy"}
+
+const dataFile = "bible_data.txt.xz"
+
+// Result is what one reader measured over the workload.
+type Result struct {
+	Reader
+	Skipped  string
+	Diff     string  // first output difference from the reference, "" if none
+	ColdMs   float64 // mean over the workload
+	WarmMs   float64 // mean of the per query medians
+	ScanMBs  float64 // uncompressed corpus MB per second for scanQuery
+	RssKB    int64   // peak over the workload
+	Syscalls int     // total over the workload
+}
+
+type readerFlags []Reader
+
+func (r *readerFlags) String() string { return "" }
+
+func (r *readerFlags) Set(v string) error {
+	name, path, ok := strings.Cut(v, "=")
+	if !ok {
+		return errors.New("want name=path")
+	}
+	*r = append(*r, Reader{name, path})
+	return nil
+}
+
+func main() {
+	var extra readerFlags
+	flag.Var(&extra, "reader", "add or replace a reader: name=path (repeatable)")
+	ref := flag.String("ref", "C++", "reader whose output the others must match")
+	only := flag.String("only", "", "only readers whose name contains this string (the reference always runs)")
+	runs := flag.Int("runs", 5, "warm runs per query; the median is used")
+	markdown := flag.Bool("markdown", false, "print a markdown table")
+	noSyscalls := flag.Bool("no-syscalls", false, "skip the ptrace syscall count")
+	flag.Parse()
+
+	list := readers
+	for _, e := range extra {
+		replaced := false
+		for i := range list {
+			if list[i].Name == e.Name {
+				list[i].Path = e.Path
+				replaced = true
+			}
+		}
+		if !replaced {
+			list = append(list, e)
+		}
+	}
+
+	corpusBytes, err := uncompressedSize(dataFile)
+	if err != nil {
+		fmt.Fprintf(os.Stderr, "Error: %v\n", err)
+		os.Exit(1)
+	}
+
+	var refOut [][]byte
+	var results []Result
+	for _, r := range list {
+		if r.Name != *ref && *only != "" && !strings.Contains(r.Name, *only) {
+			continue
+		}
+		res := Result{Reader: r}
+		bin, err := filepath.Abs(r.Path)
+		if err == nil {
+			_, err = runOnce(bin, workload[0])
+		}
+		if err != nil {
+			res.Skipped = skipReason(err)
+			results = append(results, res)
+			continue
+		}
+
+		var outs [][]byte
+		var cold, warm float64
+		for _, q := range workload {
+			evict(bin)
+			m, err := runOnce(bin, q)
+			if err != nil {
+				res.Skipped = skipReason(err)
+				break
+			}
+			cold += m.WallMs
+			outs = append(outs, m.Stdout)
+			if m.RssKB > res.RssKB {
+				res.RssKB = m.RssKB
+			}
+			med, err := warmMedian(bin, q, *runs)
+			if err != nil {
+				res.Skipped = skipReason(err)
+				break
+			}
+			warm += med
+			if !*noSyscalls {
+				n, err := countSyscalls(bin, q)
+				if err != nil {
+					fmt.Fprintf(os.Stderr, "Warning: no syscall count for %s: %v\n", r.Name, err)
+					*noSyscalls = true
+				}
+				res.Syscalls += n
+			}
+		}
+		if res.Skipped != "" {
+			results = append(results, res)
+			continue
+		}
+		res.ColdMs = cold / float64(len(workload))
+		res.WarmMs = warm / float64(len(workload))
+		if med, err := warmMedian(bin, scanQuery, *runs); err == nil && med > 0 {
+			res.ScanMBs = float64(corpusBytes) / 1e6 / (med / 1000)
+		}
+		if r.Name == *ref {
+			refOut = outs
+		} else if refOut != nil {
+			res.Diff = compare(refOut, outs)
+		} else {
+			res.Diff = "no reference"
+		}
+		results = append(results, res)
+	}
+
+	// Fastest first, skipped readers last
+	sort.SliceStable(results, func(i, j int) bool {
+		a, b := results[i], results[j]
+		if (a.Skipped == "") != (b.Skipped == "") {
+			return a.Skipped == ""
+		}
+		return a.WarmMs < b.WarmMs
+	})
+	if *markdown {
+		printMarkdown(results, *ref, *noSyscalls)
+	} else {
+		printPlain(results, *ref, *noSyscalls)
+	}
+	for _, r := range results {
+		if r.Skipped == "" && r.Diff != "" {
+			os.Exit(1)
+		}
+	}
+}
+
+// Measure is one run of a reader.
+type Measure struct {
+	Stdout []byte
+	WallMs float64
+	RssKB  int64
+}
+
+// runOnce runs the reader from its own directory and returns stdout, wall
+// time and peak RSS (wait4 covers reaped children such as the xz process).
+func runOnce(bin string, args []string) (Measure, error) {
+	cmd := exec.Command(bin, args...)
+	cmd.Dir = filepath.Dir(bin)
+	var stdout, stderr bytes.Buffer
+	cmd.Stdout = &stdout
+	cmd.Stderr = &stderr
+
+	start := time.Now()
+	err := cmd.Run()
+	wall := float64(time.Since(start).Microseconds()) / 1000
+	if err != nil {
+		return Measure{}, fmt.Errorf("%v: %s", err, strings.TrimSpace(stderr.String()))
+	}
+	var rss int64
+	if ru, ok := cmd.ProcessState.SysUsage().(*syscall.Rusage); ok {
+		rss = int64(ru.Maxrss)
+	}
+	return Measure{stdout.Bytes(), wall, rss}, nil
+}
+
+func warmMedian(bin string, args []string, runs int) (float64, error) {
+	var walls []float64
+	for i := 0; i < runs; i++ {
+		m, err := runOnce(bin, args)
+		if err != nil {
+			return 0, err
+		}
+		walls = append(walls, m.WallMs)
+	}
+	sort.Float64s(walls)
+	return walls[len(walls)/2], nil
+}
+
+func skipReason(err error) string {
+	s := err.Error()
+	switch {
+	case errors.Is(err, os.ErrNotExist) || strings.Contains(s, "no such file"):
+		return "not built"
+	case strings.Contains(s, "exec format error"):
+		return "not a Linux binary"
+	case strings.Contains(s, "GLIBC"):
+		return "needs a newer glibc"
+	}
+	if i := strings.IndexByte(s, '\n'); i >= 0 {
+		s = s[:i]
+	}
+	return s
+}
+
+// evict drops the reader, the corpus and xz from the page cache, so the next
+// run pays for the disk like the first run after boot. As root the whole
+// page cache goes (shared libraries too); otherwise only these files
+// (posix_fadvise DONTNEED).
+func evict(bin string) {
+	syscall.Sync()
+	if os.WriteFile("/proc/sys/vm/drop_caches", []byte("1"), 0) == nil {
+		return
+	}
+	files := []string{bin, filepath.Join(filepath.Dir(bin), "..", dataFile)}
+	if xz, err := exec.LookPath("xz"); err == nil {
+		files = append(files, xz)
+	}
+	for _, f := range files {
+		fd, err := syscall.Open(f, syscall.O_RDONLY, 0)
+		if err != nil {
+			continue
+		}
+		syscall.Fdatasync(fd)
+		syscall.Syscall6(syscall.SYS_FADVISE64, uintptr(fd), 0, 0, 4 /* POSIX_FADV_DONTNEED */, 0, 0)
+		syscall.Close(fd)
+	}
+}
+
+// countSyscalls runs the reader under ptrace, following forks, vforks,
+// clones and execs, and counts syscall entries of every tracee.
+func countSyscalls(bin string, args []string) (int, error) {
+	// All ptrace requests must come from the thread that is the tracer
+	runtime.LockOSThread()
+	defer runtime.UnlockOSThread()
+
+	cmd := exec.Command(bin, args...)
+	cmd.Dir = filepath.Dir(bin)
+	cmd.SysProcAttr = &syscall.SysProcAttr{Ptrace: true}
+	if err := cmd.Start(); err != nil {
+		return 0, err
+	}
+	pid := cmd.Process.Pid
+	var ws syscall.WaitStatus
+	if _, err := syscall.Wait4(pid, &ws, syscall.WALL, nil); err != nil {
+		return 0, err
+	}
+	opts := syscall.PTRACE_O_TRACESYSGOOD | syscall.PTRACE_O_TRACEFORK | syscall.PTRACE_O_TRACEVFORK |
+		syscall.PTRACE_O_TRACECLONE | syscall.PTRACE_O_TRACEEXEC
+	if err := syscall.PtraceSetOptions(pid, opts); err != nil {
+		syscall.Kill(pid, syscall.SIGKILL)
+		syscall.Wait4(pid, &ws, syscall.WALL, nil)
+		return 0, err
+	}
+	syscall.PtraceSyscall(pid, 0)
+
+	inside := map[int]bool{} // tracee is between syscall entry and exit
+	count := 0
+	for {
+		wpid, err := syscall.Wait4(-1, &ws, syscall.WALL, nil)
+		if err == syscall.ECHILD {
+			break
+		}
+		if err == syscall.EINTR {
+			continue
+		}
+		if err != nil {
+			return count, err
+		}
+		if !ws.Stopped() {
+			delete(inside, wpid)
+			continue
+		}
+		sig := ws.StopSignal()
+		switch {
+		case sig == syscall.SIGTRAP|0x80:
+			if !inside[wpid] {
+				count++
+			}
+			inside[wpid] = !inside[wpid]
+			sig = 0
+		case sig == syscall.SIGTRAP:
+			// fork / clone / exec event: not a signal to deliver
+			sig = 0
+		case sig == syscall.SIGSTOP && ws.TrapCause() == -1:
+			// A new tracee starts stopped; a real SIGSTOP would be rare here
+			sig = 0
+		}
+		syscall.PtraceSyscall(wpid, int(sig))
+	}
+	return count, nil
+}
+
+func compare(want, got [][]byte) string {
+	for i, q := range workload {
+		search := q[0] == "search"
+		w, g := normalize(want[i], search), normalize(got[i], search)
+		if !bytes.Equal(w, g) {
+			return fmt.Sprintf("`%s`: %s", strings.Join(q, " "), firstDiff(w, g))
+		}
+	}
+	return ""
+}
+
+var (
+	ansiCode  = regexp.MustCompile(`\x1b\[[0-9;]*m`)
+	searchRef = regexp.MustCompile(`^.+ (\d+):(\d+) - `)
+)
+
+const searchMore = "... too many results"
+
+// normalize removes the format differences the readers are known to have,
+// so only differences in content are reported:
+//   - the ANSI colors of the words of Jesus
+//   - cross references on their own line or on the verse line, split by
+//     ";" or ", " (the C++ reader prints " (Rom 5.8, 1Ioan 4.9)" inline)
+//   - search hits as "Book ch:v - text" or as "[ch:v] text" under the
+//     section titles, with or without their cross references
+//   - how a search says there are more hits: "next: --after N" or
+//     "... too many results"
+func normalize(out []byte, search bool) []byte {
+	var lines []string
+	for _, l := range strings.Split(ansiCode.ReplaceAllString(string(out), ""), "\n") {
+		if strings.HasPrefix(l, " (") && len(lines) > 0 {
+			lines[len(lines)-1] += l
+			continue
+		}
+		if l == "" || search && (strings.HasPrefix(l, "### ") || l == searchMore || strings.HasPrefix(l, "next: ")) {
+			continue
+		}
+		if search {
+			l = searchRef.ReplaceAllString(l, "[$1:$2] ")
+		}
+		lines = append(lines, l)
+	}
+	for k, l := range lines {
+		if i := strings.LastIndex(l, " ("); i >= 0 && strings.HasSuffix(l, ")") {
+			if search {
+				lines[k] = l[:i]
+			} else {
+				lines[k] = l[:i] + strings.ReplaceAll(strings.ReplaceAll(l[i:], ", ", ";"), ";", ", ")
+			}
+		}
+	}
+	return []byte(strings.Join(lines, "\n"))
+}
+
+func firstDiff(want, got []byte) string {
+	wl := strings.Split(string(want), "\n")
+	gl := strings.Split(string(got), "\n")
+	for i := 0; i < len(wl) || i < len(gl); i++ {
+		if i >= len(wl) || i >= len(gl) || wl[i] != gl[i] {
+			return fmt.Sprintf("line %d", i+1)
+		}
+	}
+	return "trailing bytes"
+}
+
+func uncompressedSize(path string) (int64, error) {
+	out, err := exec.Command("xz", "-dc", path).Output()
+	if err != nil {
+		return 0, fmt.Errorf("decompress %s: %v", path, err)
+	}
+	return int64(len(out)), nil
+}
+
+func verdict(r Result, ref string) string {
+	switch {
+	case r.Skipped != "":
+		return "skipped: " + r.Skipped
+	case r.Name == ref:
+		return "reference"
+	case r.Diff == "":
+		return "identical"
+	}
+	return "differs, " + r.Diff
+}
+
+func printPlain(results []Result, ref string, noSyscalls bool) {
+	fmt.Printf("%-16s %9s %9s %10s %9s %9s  %s\n", "reader", "cold ms", "warm ms", "scan MB/s", "peak KB", "syscalls", "output")
+	for _, r := range results {
+		if r.Skipped != "" {
+			fmt.Printf("%-16s %9s %9s %10s %9s %9s  %s\n", r.Name, "-", "-", "-", "-", "-", verdict(r, ref))
+			continue
+		}
+		sc := fmt.Sprint(r.Syscalls)
+		if noSyscalls {
+			sc = "-"
+		}
+		fmt.Printf("%-16s %9.1f %9.1f %10.1f %9d %9s  %s\n", r.Name, r.ColdMs, r.WarmMs, r.ScanMBs, r.RssKB, sc, verdict(r, ref))
+	}
+}
+
+func printMarkdown(results []Result, ref string, noSyscalls bool) {
+	fmt.Println("| Reader | Cold (ms) | Warm (ms) | Scan (MB/s) | Peak RSS | Syscalls | Output |")
+	fmt.Println("| :--- | ---: | ---: | ---: | ---: | ---: | :--- |")
+	for _, r := range results {
+		if r.Skipped != "" {
+			fmt.Printf("| %s | - | - | - | - | - | %s |\n", r.Name, verdict(r, ref))
+			continue
+		}
+		sc := fmt.Sprint(r.Syscalls)
+		if noSyscalls {
+			sc = "-"
+		}
+		fmt.Printf("| %s | %.1f | %.1f | %.1f | %d KB | %s | %s |\n", r.Name, r.ColdMs, r.WarmMs, r.ScanMBs, r.RssKB, sc, verdict(r, ref))
+	}
+}
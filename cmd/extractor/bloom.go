@@ -0,0 +1,123 @@
+package main
+
+import (
+	"bytes"
+	"encoding/binary"
+	"fmt"
+	"os"
+)
+
+// Chapter filters (bible_data.blm)
+//
+// One Bloom filter per chapter over the trigrams of its folded verse texts
+// (fold() of stems.go, markup included), only the trigrams of three word
+// bytes (isWordByte): a search for a literal first checks the literal's
+// trigrams against every chapter, and a chapter missing one of them is not
+// decoded at all. Verses are the blocks' unit, so trigrams never cross one.
+//
+// Each filter has bloomBits bits per distinct trigram of its chapter
+// (rounded up to 64) and bloomHashes probes: bit i of a trigram is
+// (h + i*(h>>17|1)) mod m over uint32, h = trigramHash. Fewer bits are
+// enough because a query word has several trigrams, and a chapter is kept
+// only if all of them hit.
+//
+// Layout (little endian):
+//
+//	"BBLM" u8 version u8 hashes u16 0
+//	u32 nverses, u32 nblocks
+//	u32 first[nblocks+1]  first verse of every block, then nverses
+//	u32 words[nblocks+1]  start of every filter in u64 words, then the total
+//	u64 bits[]
+const bloomBits = 4
+const bloomHashes = 2
+
+// trigramHash must stay the same as trigram_hash in bible_reader_cpp/bloom.cpp
+func trigramHash(a, b, c byte) uint32 {
+	x := (uint32(a)<<16 | uint32(b)<<8 | uint32(c)) * 0x9E3779B1
+	x ^= x >> 15
+	x *= 0x85EBCA6B
+	x ^= x >> 13
+	return x
+}
+
+// bookFilters are the chapter filters of one book's verses, with the
+// number of verses of every chapter
+type bookFilters struct {
+	Verses  []uint32
+	Filters [][]uint64
+}
+
+func chapterFilters(verses []*Verse) bookFilters {
+	var bf bookFilters
+	for lo := 0; lo < len(verses); {
+		hi := lo
+		trigrams := map[uint32]bool{}
+		for hi < len(verses) && verses[hi].Chapter == verses[lo].Chapter {
+			t := fold(verses[hi].Text)
+			for i := 0; i+2 < len(t); i++ {
+				if isWordByte(t[i]) && isWordByte(t[i+1]) && isWordByte(t[i+2]) {
+					trigrams[trigramHash(t[i], t[i+1], t[i+2])] = true
+				}
+			}
+			hi++
+		}
+		m := (len(trigrams)*bloomBits + 63) / 64
+		if m == 0 {
+			m = 1
+		}
+		bits := make([]uint64, m)
+		for h := range trigrams {
+			for i := uint32(0); i < bloomHashes; i++ {
+				bit := (h + i*(h>>17|1)) % uint32(64*m)
+				bits[bit/64] |= 1 << (bit % 64)
+			}
+		}
+		bf.Verses = append(bf.Verses, uint32(hi-lo))
+		bf.Filters = append(bf.Filters, bits)
+		lo = hi
+	}
+	return bf
+}
+
+func writeBlooms(textFile, blmFile string, seg *segmentCache) {
+	verses := readText(textFile)
+	var first []uint32
+	var filters [][]uint64
+	for lo := 0; lo < len(verses); {
+		hi := lo
+		for hi < len(verses) && verses[hi].Book == verses[lo].Book {
+			hi++
+		}
+		bf := seg.blooms(verses[lo:hi])
+		at := uint32(lo)
+		for k, n := range bf.Verses {
+			first = append(first, at)
+			filters = append(filters, bf.Filters[k])
+			at += n
+		}
+		lo = hi
+	}
+	first = append(first, uint32(len(verses)))
+
+	var buf bytes.Buffer
+	le := binary.LittleEndian
+	buf.WriteString("BBLM")
+	buf.Write([]byte{1, bloomHashes, 0, 0})
+	binary.Write(&buf, le, uint32(len(verses)))
+	binary.Write(&buf, le, uint32(len(filters)))
+	binary.Write(&buf, le, first)
+	words := uint32(0)
+	for _, f := range filters {
+		binary.Write(&buf, le, words)
+		words += uint32(len(f))
+	}
+	binary.Write(&buf, le, words)
+	for _, f := range filters {
+		binary.Write(&buf, le, f)
+	}
+	if err := os.WriteFile(blmFile, buf.Bytes(), 0644); err != nil {
+		panic(err)
+	}
+	fmt.Printf("  %d chapter filters, %d B\n", len(filters), buf.Len())
+	seg.report("blm", "blm-")
+}
@@ -2,6 +2,7 @@ package main
 
 import (
 	"bufio"
+	"flag"
 	"fmt"
 	"os"
 	"regexp"
@@ -23,23 +24,65 @@ type Verse struct {
 }
 
 func main() {
-	verses := make(map[int]*Verse)
+	from := flag.String("from", "", "build side files from an existing bible_data.txt instead of the SQL dumps")
+	tokens := flag.String("tokens", "", "also write the word-token corpus (e.g. bible_data.tok)")
+	vrs := flag.String("verses", "", "also write the per-verse random access store (e.g. bible_data.vrs)")
+	toc := flag.String("toc", "", "also write the table of contents (e.g. bible_data.toc)")
+	stems := flag.String("stems", "", "also write the stem index for search --stem (e.g. bible_data.stm)")
+	blooms := flag.String("blooms", "", "also write the per-chapter trigram filters that let scans skip chapters (e.g. bible_data.blm)")
+	canon := flag.String("canon", "", "versification map for -verses of another translation (see verses.go)")
+	segments := flag.String("segments", "", "keep per-book segments in this directory and rebuild only changed books (see segments.go)")
+	retrain := flag.Bool("retrain", false, "with -segments: train a new -verses symbol table instead of reusing the last one")
+	flag.Parse()
+
+	var seg *segmentCache
+	if *segments != "" {
+		seg = openSegments(*segments, *retrain)
+	}
+
+	textFile := *from
+	if textFile == "" {
+		verses := make(map[int]*Verse)
 
-	// 1. Parse biblia.sql (Verses)
-	fmt.Println("Parsing biblia.sql...")
-	parseVerses("biblia.sql", verses)
+		// 1. Parse biblia.sql (Verses)
+		fmt.Println("Parsing biblia.sql...")
+		parseVerses("biblia.sql", verses)
 
-	// 2. Parse biblia_titluri.sql (Titles)
-	fmt.Println("Parsing biblia_titluri.sql...")
-	parseTitles("biblia_titluri.sql", verses)
+		// 2. Parse biblia_titluri.sql (Titles)
+		fmt.Println("Parsing biblia_titluri.sql...")
+		parseTitles("biblia_titluri.sql", verses)
 
-	// 3. Parse biblia_trimiteri.sql (References)
-	fmt.Println("Parsing biblia_trimiteri.sql...")
-	parseRefs("biblia_trimiteri.sql", verses)
+		// 3. Parse biblia_trimiteri.sql (References)
+		fmt.Println("Parsing biblia_trimiteri.sql...")
+		parseRefs("biblia_trimiteri.sql", verses)
 
-	// 4. Output to bible_data.txt
-	fmt.Println("Writing bible_data.txt...")
-	writeOutput("bible_data.txt", verses)
+		// 4. Output to bible_data.txt
+		fmt.Println("Writing bible_data.txt...")
+		writeOutput("bible_data.txt", verses)
+		textFile = "bible_data.txt"
+	}
+
+	// 5. Optional side files
+	if *tokens != "" {
+		fmt.Printf("Writing %s...\n", *tokens)
+		writeTokens(textFile, *tokens, seg)
+	}
+	if *vrs != "" {
+		fmt.Printf("Writing %s...\n", *vrs)
+		writeVerseStore(textFile, *vrs, *canon, seg)
+	}
+	if *toc != "" {
+		fmt.Printf("Writing %s...\n", *toc)
+		writeTOC(textFile, *toc)
+	}
+	if *stems != "" {
+		fmt.Printf("Writing %s...\n", *stems)
+		writeStems(textFile, *stems)
+	}
+	if *blooms != "" {
+		fmt.Printf("Writing %s...\n", *blooms)
+		writeBlooms(textFile, *blooms, seg)
+	}
 
 	fmt.Println("Done!")
 }
@@ -0,0 +1,232 @@
+package main
+
+import (
+	"bytes"
+	"crypto/sha256"
+	"encoding/gob"
+	"encoding/hex"
+	"fmt"
+	"os"
+	"path/filepath"
+	"strconv"
+	"strings"
+)
+
+// Per-book segments (-segments dir)
+//
+// Without it every side file is rebuilt from scratch, which for
+// bible_data.vrs means training the symbol table again. With it, the
+// per-book work of each side file is kept in dir, named by the SHA-256 of
+// what the book contributes, and the files are merged from those segments:
+//
+//	tok-<hash>.seg        tokens of the book's lines (bible_data.tok)
+//	vrs-<sym>-<hash>.seg  its verse records coded with symbol table <sym>
+//	vrs.sym               that symbol table, reused by later builds
+//	vocab-<hash>.xz       the compressed token vocabulary
+//	blm-<hash>.seg        its chapter filters (bible_data.blm)
+//
+// An unchanged book costs one hash; only changed books are tokenized or
+// coded again. The global steps left (Huffman code, offsets) are cheap.
+// Output is byte for byte what a full build writes with the same symbol
+// table; -retrain trains a new one, which recodes every book. Segments the
+// build did not use are removed, so dir holds one generation.
+type segmentCache struct {
+	dir     string
+	retrain bool
+	used    map[string]bool
+	reused  map[string]int // per kind: books served from dir
+	built   map[string]int // per kind: books rebuilt
+}
+
+func openSegments(dir string, retrain bool) *segmentCache {
+	if err := os.MkdirAll(dir, 0755); err != nil {
+		panic(err)
+	}
+	return &segmentCache{dir: dir, retrain: retrain, used: map[string]bool{},
+		reused: map[string]int{}, built: map[string]int{}}
+}
+
+func contentHash(parts ...[]byte) string {
+	h := sha256.New()
+	for _, p := range parts {
+		h.Write(p)
+		h.Write([]byte{0})
+	}
+	return hex.EncodeToString(h.Sum(nil))[:32]
+}
+
+// load fills v from segment name, false if there is none (or it is unreadable)
+func (s *segmentCache) load(name string, v interface{}) bool {
+	s.used[name] = true
+	f, err := os.Open(filepath.Join(s.dir, name))
+	if err != nil {
+		return false
+	}
+	defer f.Close()
+	return gob.NewDecoder(f).Decode(v) == nil
+}
+
+// store writes a segment through a temporary file, so a build that dies
+// halfway never leaves a truncated segment behind
+func (s *segmentCache) store(name string, v interface{}) {
+	var buf bytes.Buffer
+	if err := gob.NewEncoder(&buf).Encode(v); err != nil {
+		panic(err)
+	}
+	path := filepath.Join(s.dir, name)
+	if err := os.WriteFile(path+".tmp", buf.Bytes(), 0644); err != nil {
+		panic(err)
+	}
+	if err := os.Rename(path+".tmp", path); err != nil {
+		panic(err)
+	}
+}
+
+// bookChunks splits the text (with its leading newline) at the first word
+// of every "# Book" line. The tokenizer ends a token there in any case, so
+// tokenizing the chunks one by one gives the tokens of the whole text.
+func bookChunks(text []byte) [][]byte {
+	var chunks [][]byte
+	start := 0
+	// From 1: a header right at the start belongs to the first chunk
+	for i := 1; ; {
+		j := bytes.Index(text[i:], []byte("\n# "))
+		if j < 0 {
+			break
+		}
+		cut := i + j + 3
+		chunks = append(chunks, text[start:cut])
+		start, i = cut, cut
+	}
+	return append(chunks, text[start:])
+}
+
+// tokens is tokenize over the whole text, book by book from dir
+func (s *segmentCache) tokens(text []byte) []string {
+	if s == nil {
+		return tokenize(text)
+	}
+	var toks []string
+	for _, chunk := range bookChunks(text) {
+		name := "tok-" + contentHash(chunk) + ".seg"
+		var seg []string
+		if s.load(name, &seg) {
+			s.reused["tok"]++
+		} else {
+			seg = tokenize(chunk)
+			s.store(name, seg)
+			s.built["tok"]++
+		}
+		toks = append(toks, seg...)
+	}
+	return toks
+}
+
+// xz is xzCompress, remembered by the hash of its input
+func (s *segmentCache) xz(data []byte) []byte {
+	if s == nil {
+		return xzCompress(data)
+	}
+	name := "vocab-" + contentHash(data) + ".xz"
+	s.used[name] = true
+	path := filepath.Join(s.dir, name)
+	if out, err := os.ReadFile(path); err == nil {
+		return out
+	}
+	out := xzCompress(data)
+	if err := os.WriteFile(path, out, 0644); err != nil {
+		panic(err)
+	}
+	return out
+}
+
+// symbols is the symbol table of the last build unless -retrain (or there
+// is none yet); train is only called to make a new one
+func (s *segmentCache) symbols(train func() *symbolTable) *symbolTable {
+	if s == nil {
+		return train()
+	}
+	var syms []string
+	if s.retrain || !s.load("vrs.sym", &syms) {
+		st := train()
+		s.store("vrs.sym", st.syms)
+		return st
+	}
+	return newSymbolTable(syms)
+}
+
+// records codes the verse records with st, book by book from dir
+func (s *segmentCache) records(verses []*Verse, records []string, st *symbolTable) [][]byte {
+	coded := make([][]byte, len(records))
+	if s == nil {
+		for i, r := range records {
+			coded[i] = st.encode(nil, r)
+		}
+		return coded
+	}
+	sym := contentHash([]byte(strings.Join(st.syms, "\x00")))
+	for lo := 0; lo < len(verses); {
+		hi := lo
+		var parts [][]byte
+		for hi < len(verses) && verses[hi].Book == verses[lo].Book {
+			parts = append(parts, []byte(records[hi]))
+			hi++
+		}
+		name := "vrs-" + sym[:16] + "-" + contentHash(parts...) + ".seg"
+		var seg [][]byte
+		if s.load(name, &seg) && len(seg) == hi-lo {
+			s.reused["vrs"]++
+		} else {
+			seg = seg[:0]
+			for i := lo; i < hi; i++ {
+				seg = append(seg, st.encode(nil, records[i]))
+			}
+			s.store(name, seg)
+			s.built["vrs"]++
+		}
+		copy(coded[lo:hi], seg)
+		lo = hi
+	}
+	return coded
+}
+
+// blooms is chapterFilters of one book, from dir when its chapters and
+// texts are unchanged. The filter parameters are part of the hash.
+func (s *segmentCache) blooms(verses []*Verse) bookFilters {
+	if s == nil {
+		return chapterFilters(verses)
+	}
+	parts := [][]byte{{bloomBits, bloomHashes}}
+	for _, v := range verses {
+		parts = append(parts, []byte(strconv.Itoa(v.Chapter)), []byte(v.Text))
+	}
+	name := "blm-" + contentHash(parts...) + ".seg"
+	var bf bookFilters
+	if s.load(name, &bf) && len(bf.Verses) == len(bf.Filters) {
+		s.reused["blm"]++
+		return bf
+	}
+	bf = chapterFilters(verses)
+	s.store(name, bf)
+	s.built["blm"]++
+	return bf
+}
+
+// report prints what one kind cost and removes that kind's unused segments
+func (s *segmentCache) report(kind string, prefixes ...string) {
+	if s == nil {
+		return
+	}
+	fmt.Printf("  segments: %d books rebuilt, %d reused\n", s.built[kind], s.reused[kind])
+	entries, err := os.ReadDir(s.dir)
+	if err != nil {
+		return
+	}
+	for _, e := range entries {
+		for _, p := range prefixes {
+			if strings.HasPrefix(e.Name(), p) && !s.used[e.Name()] {
+				os.Remove(filepath.Join(s.dir, e.Name()))
+			}
+		}
+	}
+}
@@ -0,0 +1,156 @@
+package main
+
+import (
+	"bytes"
+	"encoding/binary"
+	"fmt"
+	"os"
+	"sort"
+)
+
+// Stem index (bible_data.stm)
+//
+// A light Romanian stemmer over the folded text the reader searches
+// (lowercase ASCII, ă â î ș ş ț ţ Ă folded to a i s t, like normalize()):
+// one article / case ending, then one plural / verb ending is cut, each
+// only if at least stemMin bytes are left. Light on purpose: inflections
+// of one word meet (lumina luminii luminile lumineaza -> lumin), derived
+// words stay apart (luminos). bible_reader_cpp/stem.cpp has the same rules.
+//
+// Words are what the reader's whole-word search sees: runs of ASCII letters
+// and digits and multibyte letters, outside the <span> markup; „ ” – …
+// (E2 xx xx) separate words.
+//
+// Layout (little endian):
+//
+//	"BSTM" u8 version u8 0 u16 0
+//	u32 nverses, u32 nstems, u32 stemBytes
+//	stems: NUL terminated, sorted by bytes
+//	u32 offsets[nstems+1] into postings
+//	postings: per stem, the verse indexes as uvarint gaps (first from 0)
+const stemMin = 3
+
+var stemCase = []string{"urilor", "ilor", "elor", "ului", "lor", "lui", "ul", "le"}
+var stemEnd = []string{"easca", "eaza", "esc", "este", "esti", "eze", "eam", "eau", "ind", "and",
+	"ata", "ati", "ate", "ita", "ite", "iti", "uri", "at", "it", "ez", "ii", "ei", "ie", "ea",
+	"a", "e", "i", "u"}
+
+func cutSuffix(w string, suffixes []string) string {
+	for _, s := range suffixes {
+		if len(w) >= len(s)+stemMin && w[len(w)-len(s):] == s {
+			return w[:len(w)-len(s)]
+		}
+	}
+	return w
+}
+
+func stem(w string) string { return cutSuffix(cutSuffix(w, stemCase), stemEnd) }
+
+var foldPairs = map[string]byte{
+	"ă": 'a', "â": 'a', "î": 'i', "ș": 's',
+	"ş": 's', "ț": 't', "ţ": 't', "Ă": 'a',
+}
+
+// fold is normalize_into of the reader: the eight diacritics above, ASCII
+// lowercase, every other byte as it is
+func fold(s string) []byte {
+	out := make([]byte, 0, len(s))
+	for i := 0; i < len(s); {
+		if s[i] > 127 && i+1 < len(s) {
+			if c, ok := foldPairs[s[i:i+2]]; ok {
+				out = append(out, c)
+				i += 2
+				continue
+			}
+		}
+		c := s[i]
+		if c >= 'A' && c <= 'Z' {
+			c += 'a' - 'A'
+		}
+		out = append(out, c)
+		i++
+	}
+	return out
+}
+
+func isWordByte(c byte) bool {
+	return c >= 'a' && c <= 'z' || c >= 'A' && c <= 'Z' || c >= '0' && c <= '9' || c >= 0x80
+}
+
+// foldedWords calls f with every word of the folded text
+func foldedWords(text []byte, f func(w []byte)) {
+	for i := 0; i < len(text); {
+		c := text[i]
+		switch {
+		case c == '<':
+			for i < len(text) && text[i] != '>' {
+				i++
+			}
+			i++
+		case c == 0xE2:
+			i += 3
+		case isWordByte(c):
+			j := i
+			for j < len(text) && isWordByte(text[j]) && text[j] != 0xE2 {
+				j++
+			}
+			f(text[i:j])
+			i = j
+		default:
+			i++
+		}
+	}
+}
+
+func writeStems(textFile, stmFile string) {
+	verses := readText(textFile)
+	postings := map[string][]uint32{}
+	for i, v := range verses {
+		foldedWords(fold(v.Text), func(w []byte) {
+			s := stem(string(w))
+			p := postings[s]
+			if len(p) == 0 || p[len(p)-1] != uint32(i) {
+				postings[s] = append(p, uint32(i))
+			}
+		})
+	}
+	stems := make([]string, 0, len(postings))
+	for s := range postings {
+		stems = append(stems, s)
+	}
+	sort.Strings(stems)
+
+	var names, data bytes.Buffer
+	offsets := make([]uint32, 0, len(stems)+1)
+	var tmp [binary.MaxVarintLen32]byte
+	pairs := 0
+	for _, s := range stems {
+		names.WriteString(s)
+		names.WriteByte(0)
+		offsets = append(offsets, uint32(data.Len()))
+		prev := uint32(0)
+		for _, v := range postings[s] {
+			data.Write(tmp[:binary.PutUvarint(tmp[:], uint64(v-prev))])
+			prev = v
+		}
+		pairs += len(postings[s])
+	}
+	offsets = append(offsets, uint32(data.Len()))
+
+	var buf bytes.Buffer
+	le := binary.LittleEndian
+	buf.WriteString("BSTM")
+	buf.Write([]byte{1, 0, 0, 0})
+	binary.Write(&buf, le, uint32(len(verses)))
+	binary.Write(&buf, le, uint32(len(stems)))
+	binary.Write(&buf, le, uint32(names.Len()))
+	buf.Write(names.Bytes())
+	for _, o := range offsets {
+		binary.Write(&buf, le, o)
+	}
+	buf.Write(data.Bytes())
+	if err := os.WriteFile(stmFile, buf.Bytes(), 0644); err != nil {
+		panic(err)
+	}
+	fmt.Printf("  %d stems, %d postings, %d B\n", len(stems), pairs, buf.Len())
+}
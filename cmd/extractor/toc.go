@@ -0,0 +1,53 @@
+package main
+
+import (
+	"bytes"
+	"encoding/binary"
+	"fmt"
+	"os"
+)
+
+// Table of contents (bible_data.toc)
+//
+// The structure of the text without any of it: books, verses per chapter
+// and the section titles (the T lines) with the verse each one starts at.
+// The reader answers list, toc and title searches from it without starting
+// the xz decoder. Rebuild it whenever bible_data.txt changes.
+//
+// Layout (little endian):
+//
+//	"BTOC" u8 version u8 0 u16 0
+//	u8 nbooks, per book: name NUL, u8 nchapters, u8 verses per chapter
+//	u32 nverses, u32 ntitles
+//	per title: u32 verse index, title NUL (in verse order)
+func writeTOC(textFile, tocFile string) {
+	verses := readText(textFile)
+
+	var buf bytes.Buffer
+	le := binary.LittleEndian
+	buf.WriteString("BTOC")
+	buf.Write([]byte{1, 0, 0, 0})
+	writeBookCounts(&buf, verses)
+	binary.Write(&buf, le, uint32(len(verses)))
+
+	ntitles := 0
+	for _, v := range verses {
+		if v.Title != "" {
+			ntitles++
+		}
+	}
+	binary.Write(&buf, le, uint32(ntitles))
+	for i, v := range verses {
+		if v.Title == "" {
+			continue
+		}
+		binary.Write(&buf, le, uint32(i))
+		buf.WriteString(v.Title)
+		buf.WriteByte(0)
+	}
+
+	if err := os.WriteFile(tocFile, buf.Bytes(), 0644); err != nil {
+		panic(err)
+	}
+	fmt.Printf("  %d verses, %d titles, %d B\n", len(verses), ntitles, buf.Len())
+}
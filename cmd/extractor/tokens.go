@@ -0,0 +1,280 @@
+package main
+
+import (
+	"bufio"
+	"bytes"
+	"container/heap"
+	"encoding/binary"
+	"fmt"
+	"os"
+	"os/exec"
+	"sort"
+	"unicode"
+	"unicode/utf8"
+)
+
+// Word-token corpus (bible_data.tok)
+//
+// The text is split into alternating word and separator tokens. A single space
+// between two words is implicit (the reader puts it back), every other
+// separator run is a token of its own, including the <span> markup and the
+// newlines that delimit the #/=/T/R/verse lines. Tokens are ranked by
+// frequency and coded with a length-limited canonical Huffman code, so the
+// reader can walk token IDs without rebuilding any text.
+//
+// Layout (little endian):
+//
+//	"BTOK" u8 version u8 maxLen u16 0
+//	u32 count[maxLen]             codes per length 1..maxLen
+//	u32 nsym u32 vocabRaw u32 vocabXz
+//	vocab                         xz of NUL terminated tokens in canonical order
+//	u32 ntokens u32 streamBytes
+//	stream                        MSB-first Huffman codes
+const tokMaxLen = 24
+
+var spanTags = [][]byte{[]byte(`<span class=\'Isus\'>`), []byte(`<span class='Isus'>`), []byte(`</span>`)}
+
+func isWordRune(r rune) bool { return unicode.IsLetter(r) || unicode.IsDigit(r) }
+
+// tokenize splits text into word and separator tokens. The span tags are
+// always separators so "Isus" in the markup is never a word.
+func tokenize(text []byte) []string {
+	var toks []string
+	var sep []byte
+	i := 0
+	for i < len(text) {
+		tag := false
+		for _, t := range spanTags {
+			if bytes.HasPrefix(text[i:], t) {
+				sep = append(sep, t...)
+				i += len(t)
+				tag = true
+				break
+			}
+		}
+		if tag {
+			continue
+		}
+		r, n := utf8.DecodeRune(text[i:])
+		if !isWordRune(r) {
+			sep = append(sep, text[i:i+n]...)
+			i += n
+			continue
+		}
+		j := i
+		for j < len(text) {
+			r, n := utf8.DecodeRune(text[j:])
+			if !isWordRune(r) {
+				break
+			}
+			j += n
+		}
+		if len(sep) > 0 {
+			// Single space between two words is implicit
+			if !(string(sep) == " " && len(toks) > 0 && isWordToken(toks[len(toks)-1])) {
+				toks = append(toks, string(sep))
+			}
+			sep = sep[:0]
+		}
+		toks = append(toks, string(text[i:j]))
+		i = j
+	}
+	if len(sep) > 0 {
+		toks = append(toks, string(sep))
+	}
+	return toks
+}
+
+func isWordToken(s string) bool {
+	r, _ := utf8.DecodeRuneInString(s)
+	return isWordRune(r)
+}
+
+type huffNode struct {
+	freq        int
+	sym         int
+	left, right *huffNode
+}
+
+type huffHeap []*huffNode
+
+func (h huffHeap) Len() int            { return len(h) }
+func (h huffHeap) Less(i, j int) bool  { return h[i].freq < h[j].freq }
+func (h huffHeap) Swap(i, j int)       { h[i], h[j] = h[j], h[i] }
+func (h *huffHeap) Push(x interface{}) { *h = append(*h, x.(*huffNode)) }
+func (h *huffHeap) Pop() interface{} {
+	old := *h
+	n := old[len(old)-1]
+	*h = old[:len(old)-1]
+	return n
+}
+
+// codeLengths builds Huffman code lengths, flattening the frequencies until
+// no code is longer than tokMaxLen.
+func codeLengths(freqs []int) []int {
+	f := append([]int(nil), freqs...)
+	for {
+		h := &huffHeap{}
+		for s, n := range f {
+			*h = append(*h, &huffNode{freq: n, sym: s})
+		}
+		heap.Init(h)
+		for h.Len() > 1 {
+			a := heap.Pop(h).(*huffNode)
+			b := heap.Pop(h).(*huffNode)
+			heap.Push(h, &huffNode{freq: a.freq + b.freq, sym: -1, left: a, right: b})
+		}
+		lens := make([]int, len(f))
+		maxLen := 0
+		var walk func(n *huffNode, d int)
+		walk = func(n *huffNode, d int) {
+			if n.sym >= 0 {
+				if d == 0 {
+					d = 1
+				}
+				lens[n.sym] = d
+				if d > maxLen {
+					maxLen = d
+				}
+				return
+			}
+			walk(n.left, d+1)
+			walk(n.right, d+1)
+		}
+		walk((*h)[0], 0)
+		if maxLen <= tokMaxLen {
+			return lens
+		}
+		for i := range f {
+			f[i] = f[i]/2 + 1
+		}
+	}
+}
+
+type bitWriter struct {
+	buf   []byte
+	acc   uint64
+	nbits uint
+}
+
+func (w *bitWriter) write(code uint32, n int) {
+	w.acc = w.acc<<uint(n) | uint64(code)
+	w.nbits += uint(n)
+	for w.nbits >= 8 {
+		w.nbits -= 8
+		w.buf = append(w.buf, byte(w.acc>>w.nbits))
+	}
+}
+
+func (w *bitWriter) flush() {
+	if w.nbits > 0 {
+		w.buf = append(w.buf, byte(w.acc<<(8-w.nbits)))
+		w.nbits = 0
+	}
+}
+
+func xzCompress(data []byte) []byte {
+	cmd := exec.Command("xz", "-9e", "-c", "--format=xz", "--check=crc32")
+	cmd.Stdin = bytes.NewReader(data)
+	out, err := cmd.Output()
+	if err != nil {
+		panic(fmt.Errorf("xz: %v", err))
+	}
+	return out
+}
+
+func writeTokens(textFile, tokFile string, seg *segmentCache) {
+	text, err := os.ReadFile(textFile)
+	if err != nil {
+		panic(err)
+	}
+	// Leading newline so the first '#' line starts like every other line
+	toks := seg.tokens(append([]byte("\n"), text...))
+
+	freq := map[string]int{}
+	for _, t := range toks {
+		freq[t]++
+	}
+	vocab := make([]string, 0, len(freq))
+	for t := range freq {
+		vocab = append(vocab, t)
+	}
+	sort.Slice(vocab, func(i, j int) bool {
+		if freq[vocab[i]] != freq[vocab[j]] {
+			return freq[vocab[i]] > freq[vocab[j]]
+		}
+		return vocab[i] < vocab[j]
+	})
+	freqs := make([]int, len(vocab))
+	for i, t := range vocab {
+		freqs[i] = freq[t]
+	}
+	lens := codeLengths(freqs)
+
+	// Canonical order: by code length, then by rank
+	order := make([]int, len(vocab))
+	for i := range order {
+		order[i] = i
+	}
+	sort.SliceStable(order, func(i, j int) bool { return lens[order[i]] < lens[order[j]] })
+
+	maxLen := 0
+	counts := make([]uint32, tokMaxLen+1)
+	for _, l := range lens {
+		counts[l]++
+		if l > maxLen {
+			maxLen = l
+		}
+	}
+	codes := map[string]uint32{}
+	codeLen := map[string]int{}
+	code := uint32(0)
+	prevLen := 0
+	for _, s := range order {
+		l := lens[s]
+		code <<= uint(l - prevLen)
+		prevLen = l
+		codes[vocab[s]] = code
+		codeLen[vocab[s]] = l
+		code++
+	}
+
+	var raw bytes.Buffer
+	for _, s := range order {
+		raw.WriteString(vocab[s])
+		raw.WriteByte(0)
+	}
+	vocabXz := seg.xz(raw.Bytes())
+
+	bw := &bitWriter{}
+	for _, t := range toks {
+		bw.write(codes[t], codeLen[t])
+	}
+	bw.flush()
+
+	file, err := os.Create(tokFile)
+	if err != nil {
+		panic(err)
+	}
+	defer file.Close()
+	w := bufio.NewWriter(file)
+	le := binary.LittleEndian
+	w.WriteString("BTOK")
+	w.Write([]byte{1, byte(maxLen), 0, 0})
+	for l := 1; l <= maxLen; l++ {
+		binary.Write(w, le, counts[l])
+	}
+	binary.Write(w, le, uint32(len(vocab)))
+	binary.Write(w, le, uint32(raw.Len()))
+	binary.Write(w, le, uint32(len(vocabXz)))
+	w.Write(vocabXz)
+	binary.Write(w, le, uint32(len(toks)))
+	binary.Write(w, le, uint32(len(bw.buf)))
+	w.Write(bw.buf)
+	w.Flush()
+
+	fmt.Printf("  %d tokens, %d distinct (max code %d bits)\n", len(toks), len(vocab), maxLen)
+	fmt.Printf("  vocab %d B (%d B raw), stream %d B, total %d B\n",
+		len(vocabXz), raw.Len(), len(bw.buf), 8+4*maxLen+12+len(vocabXz)+8+len(bw.buf))
+	seg.report("tok", "tok-", "vocab-")
+}
@@ -0,0 +1,353 @@
+package main
+
+import (
+	"bufio"
+	"bytes"
+	"encoding/binary"
+	"fmt"
+	"os"
+	"regexp"
+	"sort"
+	"strconv"
+	"strings"
+)
+
+// Per-verse random access store (bible_data.vrs)
+//
+// Every verse record ("title \x1f text \x1f refs") is compressed on its own
+// with one shared FSST-style symbol table: up to 255 symbols of 1-8 bytes,
+// code 255 escapes a literal byte. A u32 offset per verse points at its
+// record, so the reader can decode any verse without touching the others.
+//
+// Layout (little endian):
+//
+//	"BVRS" u8 version u8 nsym u16 0
+//	nsym x (u8 len, 8 bytes symbol)
+//	u8 nbooks, per book: name NUL, u8 nchapters, u8 verses per chapter
+//	u32 nverses, u32 offsets[nverses+1] (relative to the data start)
+//	version 2 only: u32 canon[nverses]
+//	data
+//
+// Version 2 is written for other translations (-canon map.txt): canon holds
+// the canonical verse ID of every verse, packed like the reader's VerseRef
+// (book << 24 | chapter << 12 | verse, book = position 1-66), 0 when the
+// verse has no canonical counterpart. The canonical versification is the
+// one of bible_data.txt; the map lists where this translation differs, one
+// rule per line, in its own book names (# starts a comment):
+//
+//	Maleahi 3:19-24 = Maleahi 4:1     (verses 19-24 are canonical 4:1-6)
+//	Psalmii 3:1 = -                   (no canonical counterpart)
+//
+// Verses not named by a rule keep their own book / chapter / verse.
+const (
+	fsstEscape  = 255
+	fsstMaxSyms = 255
+	fsstMaxLen  = 8
+	recordSep   = "\x1f"
+)
+
+// readText parses bible_data.txt back into verses, in file order.
+func readText(filename string) []*Verse {
+	file, err := os.Open(filename)
+	if err != nil {
+		panic(err)
+	}
+	defer file.Close()
+
+	var verses []*Verse
+	book, title := "", ""
+	chapter, testament := 0, 1
+	books := 0
+	sc := bufio.NewScanner(file)
+	sc.Buffer(make([]byte, 1<<20), 1<<20)
+	for sc.Scan() {
+		line := sc.Text()
+		if line == "" {
+			continue
+		}
+		switch line[0] {
+		case '#':
+			book = line[2:]
+			books++
+			if books > 39 {
+				testament = 2
+			}
+			chapter, title = 0, ""
+		case '=':
+			chapter, _ = strconv.Atoi(line[2:])
+			title = ""
+		case 'T':
+			title = line[2:]
+		case 'R':
+			if len(verses) > 0 {
+				verses[len(verses)-1].Refs = strings.Split(line[2:], ";")
+			}
+		default:
+			sp := strings.IndexByte(line, ' ')
+			if sp < 0 {
+				continue
+			}
+			n, err := strconv.Atoi(line[:sp])
+			if err != nil {
+				continue
+			}
+			verses = append(verses, &Verse{
+				ID:        len(verses) + 1,
+				Testament: testament,
+				Book:      book,
+				Chapter:   chapter,
+				VerseNum:  n,
+				Text:      line[sp+1:],
+				Title:     title,
+			})
+			title = ""
+		}
+	}
+	if err := sc.Err(); err != nil {
+		panic(err)
+	}
+	return verses
+}
+
+func verseRecord(v *Verse) string {
+	return v.Title + recordSep + v.Text + recordSep + strings.Join(v.Refs, ";")
+}
+
+type symbolTable struct {
+	syms  []string
+	index map[string]int
+}
+
+func newSymbolTable(syms []string) *symbolTable {
+	st := &symbolTable{syms: syms, index: map[string]int{}}
+	for i, s := range syms {
+		st.index[s] = i
+	}
+	return st
+}
+
+// next returns the code of the longest symbol at s, or -1 for an escape.
+func (st *symbolTable) next(s string) (int, int) {
+	max := fsstMaxLen
+	if len(s) < max {
+		max = len(s)
+	}
+	for l := max; l > 0; l-- {
+		if c, ok := st.index[s[:l]]; ok {
+			return c, l
+		}
+	}
+	return -1, 1
+}
+
+func (st *symbolTable) encode(dst []byte, s string) []byte {
+	for len(s) > 0 {
+		c, l := st.next(s)
+		if c < 0 {
+			dst = append(dst, fsstEscape, s[0])
+		} else {
+			dst = append(dst, byte(c))
+		}
+		s = s[l:]
+	}
+	return dst
+}
+
+// trainSymbols is the FSST training loop: encode a sample with the current
+// table, count symbols and concatenations of neighbouring symbols, keep the
+// 255 candidates with the highest gain (frequency x length), repeat.
+func trainSymbols(sample []string) *symbolTable {
+	st := newSymbolTable(nil)
+	for round := 0; round < 5; round++ {
+		gain := map[string]int{}
+		for _, s := range sample {
+			prev := ""
+			for len(s) > 0 {
+				c, l := st.next(s)
+				cur := s[:l]
+				if c < 0 {
+					cur = s[:1]
+				}
+				gain[cur] += len(cur)
+				if prev != "" && len(prev)+len(cur) <= fsstMaxLen {
+					gain[prev+cur] += len(prev) + len(cur)
+				}
+				prev = cur
+				s = s[l:]
+			}
+		}
+		cands := make([]string, 0, len(gain))
+		for s := range gain {
+			cands = append(cands, s)
+		}
+		sort.Slice(cands, func(i, j int) bool {
+			if gain[cands[i]] != gain[cands[j]] {
+				return gain[cands[i]] > gain[cands[j]]
+			}
+			return cands[i] < cands[j]
+		})
+		if len(cands) > fsstMaxSyms {
+			cands = cands[:fsstMaxSyms]
+		}
+		st = newSymbolTable(cands)
+	}
+	return st
+}
+
+var canonRule = regexp.MustCompile(`^(.+?) (\d+):(\d+)(?:-(\d+))? = (?:(.+?) (\d+):(\d+)|-)$`)
+
+func packRef(book, chapter, verse int) uint32 {
+	return uint32(book)<<24 | uint32(chapter)<<12 | uint32(verse)
+}
+
+// canonicalIDs applies the versification map to the verses of a translation.
+func canonicalIDs(verses []*Verse, mapFile string) []uint32 {
+	bookNum := map[string]int{}
+	local := map[uint32]int{}
+	ids := make([]uint32, len(verses))
+	for i, v := range verses {
+		if _, ok := bookNum[v.Book]; !ok {
+			bookNum[v.Book] = len(bookNum) + 1
+		}
+		ids[i] = packRef(bookNum[v.Book], v.Chapter, v.VerseNum)
+		local[ids[i]] = i
+	}
+
+	file, err := os.Open(mapFile)
+	if err != nil {
+		panic(err)
+	}
+	defer file.Close()
+	sc := bufio.NewScanner(file)
+	for n := 1; sc.Scan(); n++ {
+		line := strings.TrimSpace(sc.Text())
+		if i := strings.IndexByte(line, '#'); i >= 0 {
+			line = strings.TrimSpace(line[:i])
+		}
+		if line == "" {
+			continue
+		}
+		m := canonRule.FindStringSubmatch(line)
+		if m == nil || bookNum[m[1]] == 0 || (m[5] != "" && bookNum[m[5]] == 0) {
+			panic(fmt.Sprintf("%s:%d: bad rule %q", mapFile, n, line))
+		}
+		chapter, _ := strconv.Atoi(m[2])
+		first, _ := strconv.Atoi(m[3])
+		last := first
+		if m[4] != "" {
+			last, _ = strconv.Atoi(m[4])
+		}
+		toChapter, _ := strconv.Atoi(m[6])
+		toVerse, _ := strconv.Atoi(m[7])
+		for v := first; v <= last; v++ {
+			i, ok := local[packRef(bookNum[m[1]], chapter, v)]
+			if !ok {
+				panic(fmt.Sprintf("%s:%d: no verse %s %d:%d", mapFile, n, m[1], chapter, v))
+			}
+			ids[i] = 0
+			if m[5] != "" {
+				ids[i] = packRef(bookNum[m[5]], toChapter, toVerse+v-first)
+			}
+		}
+	}
+	if err := sc.Err(); err != nil {
+		panic(err)
+	}
+	return ids
+}
+
+// writeBookCounts writes the structure shared by the side file headers:
+// u8 nbooks, per book: name NUL, u8 nchapters, u8 verses per chapter.
+func writeBookCounts(hdr *bytes.Buffer, verses []*Verse) {
+	type book struct {
+		name     string
+		chapters []int
+	}
+	var books []*book
+	for _, v := range verses {
+		if len(books) == 0 || books[len(books)-1].name != v.Book {
+			books = append(books, &book{name: v.Book})
+		}
+		b := books[len(books)-1]
+		for len(b.chapters) < v.Chapter {
+			b.chapters = append(b.chapters, 0)
+		}
+		b.chapters[v.Chapter-1]++
+	}
+	hdr.WriteByte(byte(len(books)))
+	for _, b := range books {
+		hdr.WriteString(b.name)
+		hdr.WriteByte(0)
+		hdr.WriteByte(byte(len(b.chapters)))
+		for _, n := range b.chapters {
+			hdr.WriteByte(byte(n))
+		}
+	}
+}
+
+func writeVerseStore(textFile, vrsFile, canonFile string, seg *segmentCache) {
+	verses := readText(textFile)
+	version := byte(1)
+	var canon []uint32
+	if canonFile != "" {
+		version = 2
+		canon = canonicalIDs(verses, canonFile)
+	}
+
+	records := make([]string, len(verses))
+	for i, v := range verses {
+		records[i] = verseRecord(v)
+	}
+	st := seg.symbols(func() *symbolTable {
+		var sample []string
+		for i := 0; i < len(records); i += 4 {
+			sample = append(sample, records[i])
+		}
+		return trainSymbols(sample)
+	})
+
+	var data []byte
+	offsets := make([]uint32, 0, len(verses)+1)
+	for _, c := range seg.records(verses, records, st) {
+		offsets = append(offsets, uint32(len(data)))
+		data = append(data, c...)
+	}
+	offsets = append(offsets, uint32(len(data)))
+
+	var hdr bytes.Buffer
+	le := binary.LittleEndian
+	hdr.WriteString("BVRS")
+	hdr.Write([]byte{version, byte(len(st.syms)), 0, 0})
+	for _, s := range st.syms {
+		var sym [fsstMaxLen]byte
+		copy(sym[:], s)
+		hdr.WriteByte(byte(len(s)))
+		hdr.Write(sym[:])
+	}
+
+	writeBookCounts(&hdr, verses)
+	binary.Write(&hdr, le, uint32(len(verses)))
+	for _, o := range offsets {
+		binary.Write(&hdr, le, o)
+	}
+	for _, id := range canon {
+		binary.Write(&hdr, le, id)
+	}
+
+	file, err := os.Create(vrsFile)
+	if err != nil {
+		panic(err)
+	}
+	defer file.Close()
+	file.Write(hdr.Bytes())
+	file.Write(data)
+
+	raw := 0
+	for _, r := range records {
+		raw += len(r)
+	}
+	fmt.Printf("  %d verses, %d symbols, records %d B -> %d B (%.2fx)\n",
+		len(verses), len(st.syms), raw, len(data), float64(raw)/float64(len(data)))
+	fmt.Printf("  header + offsets %d B, total %d B\n", hdr.Len(), hdr.Len()+len(data))
+	seg.report("vrs", "vrs-")
+}
@@ -0,0 +1,350 @@
+package main
+
+// Regression suite for the C++ reader.
+//
+// Every case runs the reader binary, compares stdout byte for byte against a
+// golden file and checks wall time / peak RSS against a baseline recorded on
+// this machine. Run from the repository root:
+//
+//	go run cmd/regress/main.go                 # check
+//	go run cmd/regress/main.go -update         # rewrite goldens + baseline
+//	go run cmd/regress/main.go -update-baseline # only re-record budgets
+//	go run cmd/regress/main.go -data side       # same goldens, every side file
+//	go run cmd/regress/main.go -data blocks     # same goldens, multi-block xz
+
+import (
+	"bytes"
+	"encoding/json"
+	"flag"
+	"fmt"
+	"os"
+	"os/exec"
+	"path/filepath"
+	"sort"
+	"strings"
+	"syscall"
+	"time"
+)
+
+// Case is one reader invocation with a golden output file.
+type Case struct {
+	Name string
+	Args []string
+}
+
+// Budget is the recorded cost of a case on this machine.
+type Budget struct {
+	WallMs float64 `json:"wall_ms"`
+	RssKB  int64   `json:"rss_kb"`
+}
+
+// Cases cover the output quirks that speed work tends to break: titles only
+// before the first printed verse, R refs rewritten with ", ", the Isus spans
+// turned into ANSI colors and the 50-result search cap.
+var cases = []Case{
+	{"read_ioan_3_16", []string{"read", "Ioan", "3", "16"}},
+	{"read_geneza_1", []string{"read", "Geneza", "1"}},
+	{"read_psalmii_23", []string{"read", "Psalmii", "23"}},
+	{"read_1_samuel_3_10", []string{"read", "1 Samuel", "3", "10"}},
+	{"read_matei_5", []string{"read", "Matei", "5"}},
+	{"read_apocalipsa_22_21", []string{"read", "Apocalipsa", "22", "21"}},
+	{"read_case_insensitive", []string{"read", "ioan", "1", "1"}},
+	{"read_unknown_book", []string{"read", "Nimic", "1", "1"}},
+	{"search_miazazi", []string{"search", "miazăzi"}},
+	{"search_folded", []string{"search", "MIAZAZI"}},
+	{"search_capped", []string{"search", "lumina"}},
+	{"search_rare", []string{"search", "Melhisedec"}},
+	{"search_phrase", []string{"search", "Eu", "sunt", "Calea"}},
+	{"search_none", []string{"search", "xyzzy"}},
+	{"search_regex", []string{"search", "--regex", `\bfiu(l|lui) omului\b`, "--limit", "5"}},
+	{"search_query", []string{"search", "dragoste AND NOT lege in:Ioan"}},
+	{"search_first_book", []string{"search", "in:Geneza lumina"}},
+	{"search_after", []string{"search", "lumina", "--limit", "3", "--after", "4"}},
+	{"search_context", []string{"search", "Melhisedec", "--context", "1"}},
+	{"search_kwic", []string{"search", "--regex", "lumin\\w*", "--kwic=20", "--highlight", "--limit", "5"}},
+	{"freq", []string{"freq", "15", "--by=testament"}},
+	{"concordance", []string{"concordance", "Melhisedec"}},
+	{"format_ndjson", []string{"read", "Matei", "20", "--format=ndjson"}},
+	{"format_tsv", []string{"search", "Melhisedec", "--format=tsv"}},
+	{"list", []string{"list"}},
+	{"toc_rut", []string{"toc", "Rut"}},
+	{"search_titles", []string{"search", "--titles", "naşterea"}},
+	{"histogram_chapter", []string{"search", "har in:Romani", "--histogram=chapter"}},
+	{"search_stem", []string{"search", "--stem", "lumină", "--kwic=15", "--highlight", "--limit", "12"}},
+	// --word on bible_data.tok must agree with the text scans: punctuation,
+	// „ and odd spacing in the query are separators the tokens do not hold
+	{"search_word_hyphen", []string{"search", "--word", "s-a dus", "--count"}},
+	{"search_word_comma", []string{"search", "--word", "lumină,", "--count"}},
+	{"search_word_bang", []string{"search", "--word", "Dumnezeu!", "--count"}},
+	{"search_word_period", []string{"search", "--word", "Domnul.", "--count"}},
+	{"search_word_quote", []string{"search", "--word", "zis: „Să", "--count"}},
+	{"search_word_spaces", []string{"search", "--word", "fiul  omului", "--count"}},
+	{"search_word_lead", []string{"search", "--word", " fiul", "--count"}},
+}
+
+func main() {
+	bin := flag.String("bin", "bible_reader_cpp/main_linux", "reader binary (run from its own directory)")
+	dir := flag.String("dir", "cmd/regress/testdata", "golden file directory")
+	baselinePath := flag.String("baseline", "", "baseline file (default <dir>/baseline_<host>.json)")
+	runs := flag.Int("runs", 5, "timed runs per case; the median is compared")
+	tol := flag.Float64("tol", 0.25, "allowed fractional slowdown / memory growth over the baseline")
+	slack := flag.Duration("slack", 5*time.Millisecond, "absolute wall time slack added to every budget")
+	update := flag.Bool("update", false, "rewrite golden files and baseline")
+	updateBaseline := flag.Bool("update-baseline", false, "rewrite the baseline only")
+	only := flag.String("run", "", "only run cases whose name contains this string")
+	data := flag.String("data", "", "check against a temporary data directory: side (every side file) or blocks (multi-block xz)")
+	flag.Parse()
+
+	if *baselinePath == "" {
+		host, _ := os.Hostname()
+		name := "baseline_" + host
+		if *data != "" {
+			name += "_" + *data
+		}
+		*baselinePath = filepath.Join(*dir, name+".json")
+	}
+
+	absBin, err := filepath.Abs(*bin)
+	if err != nil {
+		panic(err)
+	}
+	tmp := ""
+	if *data != "" {
+		if tmp, err = os.MkdirTemp("", "regress-"); err != nil {
+			panic(err)
+		}
+		switch *data {
+		case "side":
+			absBin = sideData(absBin, tmp)
+		case "blocks":
+			absBin = blockData(absBin, tmp)
+		default:
+			os.RemoveAll(tmp)
+			fmt.Printf("Unknown -data %s\n", *data)
+			os.Exit(2)
+		}
+	}
+
+	baseline := map[string]Budget{}
+	if data, err := os.ReadFile(*baselinePath); err == nil {
+		if err := json.Unmarshal(data, &baseline); err != nil {
+			panic(err)
+		}
+	} else if !*update && !*updateBaseline {
+		fmt.Printf("No baseline at %s, only checking output (record one with -update-baseline)\n", *baselinePath)
+	}
+
+	if *update {
+		if err := os.MkdirAll(*dir, 0755); err != nil {
+			panic(err)
+		}
+	}
+
+	failed := 0
+	measured := map[string]Budget{}
+	for _, c := range cases {
+		if *only != "" && !strings.Contains(c.Name, *only) {
+			continue
+		}
+		golden := filepath.Join(*dir, c.Name+".golden")
+
+		out, _, _, err := runOnce(absBin, c.Args)
+		if err != nil {
+			fmt.Printf("FAIL %-24s %v\n", c.Name, err)
+			failed++
+			continue
+		}
+
+		if *update {
+			if err := os.WriteFile(golden, out, 0644); err != nil {
+				panic(err)
+			}
+		} else if want, err := os.ReadFile(golden); err != nil {
+			fmt.Printf("FAIL %-24s missing golden %s\n", c.Name, golden)
+			failed++
+			continue
+		} else if !bytes.Equal(out, want) {
+			fmt.Printf("FAIL %-24s output differs: %s\n", c.Name, firstDiff(want, out))
+			failed++
+			continue
+		}
+
+		var walls []float64
+		var rss int64
+		for i := 0; i < *runs; i++ {
+			_, wall, maxrss, err := runOnce(absBin, c.Args)
+			if err != nil {
+				panic(err)
+			}
+			walls = append(walls, wall)
+			if maxrss > rss {
+				rss = maxrss
+			}
+		}
+		sort.Float64s(walls)
+		got := Budget{WallMs: walls[len(walls)/2], RssKB: rss}
+		measured[c.Name] = got
+
+		status := "ok  "
+		note := ""
+		if b, ok := baseline[c.Name]; ok && !*update && !*updateBaseline {
+			wallLimit := b.WallMs*(1+*tol) + float64(slack.Microseconds())/1000
+			rssLimit := int64(float64(b.RssKB) * (1 + *tol))
+			if got.WallMs > wallLimit {
+				status = "FAIL"
+				note += fmt.Sprintf(" wall %.1fms > budget %.1fms", got.WallMs, wallLimit)
+			}
+			if got.RssKB > rssLimit {
+				status = "FAIL"
+				note += fmt.Sprintf(" rss %dKB > budget %dKB", got.RssKB, rssLimit)
+			}
+		}
+		if status == "FAIL" {
+			failed++
+		}
+		fmt.Printf("%s %-24s %8.1fms %8dKB%s\n", status, c.Name, got.WallMs, got.RssKB, note)
+	}
+
+	if *update || *updateBaseline {
+		for name, b := range measured {
+			baseline[name] = b
+		}
+		data, _ := json.MarshalIndent(baseline, "", "  ")
+		if err := os.WriteFile(*baselinePath, append(data, '\n'), 0644); err != nil {
+			panic(err)
+		}
+		fmt.Printf("Wrote baseline %s\n", *baselinePath)
+	}
+
+	if tmp != "" {
+		os.RemoveAll(tmp)
+	}
+	if failed > 0 {
+		fmt.Printf("%d case(s) failed\n", failed)
+		os.Exit(1)
+	}
+	fmt.Println("All cases passed")
+}
+
+// sideData sets up tmp as a data directory: the shipped bible_data.txt.xz,
+// every side file cmd/extractor writes from it, and a copy of the reader in
+// tmp/bin (it finds its data one level above itself). Returns that copy.
+// The side files are gitignored, so this is the only way the suite sees
+// the .vrs / .tok / .toc / .stm / .blm paths.
+func sideData(bin, tmp string) string {
+	root := filepath.Dir(filepath.Dir(bin))
+	copyFile(filepath.Join(root, "bible_data.txt.xz"), filepath.Join(tmp, "bible_data.txt.xz"))
+	txt := unpackText(bin, tmp)
+
+	// No go.mod: build the extractor from its file list
+	srcs, _ := filepath.Glob(filepath.Join(root, "cmd", "extractor", "*.go"))
+	extractor := filepath.Join(tmp, "extractor")
+	run(exec.Command("go", append([]string{"build", "-o", extractor}, srcs...)...))
+	side := func(ext string) string { return filepath.Join(tmp, "bible_data."+ext) }
+	run(exec.Command(extractor, "-from", txt, "-tokens", side("tok"), "-verses", side("vrs"),
+		"-toc", side("toc"), "-stems", side("stm"), "-blooms", side("blm")))
+	os.Remove(txt)
+	os.Remove(extractor)
+	return readerCopy(bin, tmp)
+}
+
+// blockData sets up tmp with bible_data.txt.xz recompressed into
+// independent 256 KiB blocks (the shipped file is a single block), so the
+// reader decodes it on its thread pool. Returns the copy of the reader.
+func blockData(bin, tmp string) string {
+	txt := unpackText(bin, tmp)
+	out, err := exec.Command("xz", "-z", "-c", "--block-size=256KiB", txt).Output()
+	if err != nil {
+		panic(fmt.Sprintf("xz --block-size: %v", err))
+	}
+	if err := os.WriteFile(filepath.Join(tmp, "bible_data.txt.xz"), out, 0644); err != nil {
+		panic(err)
+	}
+	os.Remove(txt)
+	return readerCopy(bin, tmp)
+}
+
+// unpackText decompresses the shipped text into tmp and returns its path
+func unpackText(bin, tmp string) string {
+	root := filepath.Dir(filepath.Dir(bin))
+	out, err := exec.Command("xz", "-dc", filepath.Join(root, "bible_data.txt.xz")).Output()
+	if err != nil {
+		panic(fmt.Sprintf("xz -dc: %v", err))
+	}
+	txt := filepath.Join(tmp, "bible_data.txt")
+	if err := os.WriteFile(txt, out, 0644); err != nil {
+		panic(err)
+	}
+	return txt
+}
+
+// readerCopy puts the reader into tmp/bin and returns its path
+func readerCopy(bin, tmp string) string {
+	if err := os.Mkdir(filepath.Join(tmp, "bin"), 0755); err != nil {
+		panic(err)
+	}
+	dst := filepath.Join(tmp, "bin", filepath.Base(bin))
+	copyFile(bin, dst)
+	if err := os.Chmod(dst, 0755); err != nil {
+		panic(err)
+	}
+	return dst
+}
+
+func copyFile(src, dst string) {
+	data, err := os.ReadFile(src)
+	if err != nil {
+		panic(err)
+	}
+	if err := os.WriteFile(dst, data, 0644); err != nil {
+		panic(err)
+	}
+}
+
+func run(cmd *exec.Cmd) {
+	if out, err := cmd.CombinedOutput(); err != nil {
+		panic(fmt.Sprintf("%v: %v\n%s", cmd.Args, err, out))
+	}
+}
+
+// runOnce runs the reader from its own directory (it finds the data as
+// ../bible_data.txt.xz) and returns stdout, wall time in ms and peak RSS in KB.
+// Peak RSS comes from wait4, so it includes the reaped xz child as well.
+func runOnce(bin string, args []string) ([]byte, float64, int64, error) {
+	cmd := exec.Command(bin, args...)
+	cmd.Dir = filepath.Dir(bin)
+	var stdout, stderr bytes.Buffer
+	cmd.Stdout = &stdout
+	cmd.Stderr = &stderr
+
+	start := time.Now()
+	err := cmd.Run()
+	wall := float64(time.Since(start).Microseconds()) / 1000
+	if err != nil {
+		return nil, 0, 0, fmt.Errorf("%v: %s", err, strings.TrimSpace(stderr.String()))
+	}
+
+	var rss int64
+	if ru, ok := cmd.ProcessState.SysUsage().(*syscall.Rusage); ok {
+		rss = int64(ru.Maxrss)
+	}
+	return stdout.Bytes(), wall, rss, nil
+}
+
+func firstDiff(want, got []byte) string {
+	wl := strings.Split(string(want), "\n")
+	gl := strings.Split(string(got), "\n")
+	for i := 0; i < len(wl) || i < len(gl); i++ {
+		var w, g string
+		if i < len(wl) {
+			w = wl[i]
+		}
+		if i < len(gl) {
+			g = gl[i]
+		}
+		if w != g {
+			return fmt.Sprintf("line %d\n    want: %q\n    got:  %q", i+1, w, g)
+		}
+	}
+	return "trailing bytes"
+}